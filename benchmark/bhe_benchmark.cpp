@@ -0,0 +1,309 @@
+#include "pch.h"
+/*
+BHE SETUP TOOL BENCHMARK
+------------------------------------------------------------------------------
+* Generates synthetic BHE fields (regular or random grids, L element levels)
+* Meshes the plane once with the built-in mesher and stores it as binary
+  GMSH msh2 file, so gmsh itself is not part of the measurement
+* Regular grids are also meshed by replicating one cell (-mesher patch)
+* Times the pipeline stages on these inputs and reports throughput
+------------------------------------------------------------------------------
+Usage: bhe_benchmark (-suite quick|full) (-repeat n) (-threads n) (-output file.csv) (-workdir directory)
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "instrumentation.h"
+#include "msh_writer.h"
+#include "patch_mesher.h"
+#include "pipeline.h"
+#include "plane_mesher.h"
+#include "vtu_writer.h"
+
+using namespace std;
+
+struct benchmark_case
+{
+    const char *name;
+    int n_bhe_x, n_bhe_y;
+    bool random_field;
+    int n_levels;
+    double elem_size_box, elem_size_corner;
+    bool full_only;
+};
+
+// Field spacing is 8 m, the box keeps 20 m around the field and the domain 100 m around the box
+static const benchmark_case benchmark_cases[] = {
+    { "grid_2x2_L40", 2, 2, false, 40, 5.0, 20.0, false },
+    { "grid_5x5_L100", 5, 5, false, 100, 5.0, 20.0, false },
+    { "random_25_L100", 5, 5, true, 100, 5.0, 20.0, false },
+    { "grid_10x10_L100", 10, 10, false, 100, 3.0, 20.0, false },
+    { "grid_10x10_L400", 10, 10, false, 400, 3.0, 20.0, true },
+    { "grid_20x20_L200", 20, 20, false, 200, 3.0, 20.0, true },
+};
+
+struct benchmark_result
+{
+    string case_name;
+    string stage;
+    double seconds;
+    uint64_t items;
+    const char *item_name;
+    uint64_t bytes;
+};
+
+// Writes the input file of a synthetic field
+static void WriteSyntheticInput(const benchmark_case &bc, const string &input_filename)
+{
+    const double spacing = 8.0, box_margin = 20.0, domain_margin = 100.0;
+    double field_width = (bc.n_bhe_x - 1) * spacing;
+    double field_length = (bc.n_bhe_y - 1) * spacing;
+    double box_width = field_width + 2.0 * box_margin;
+    double box_length = field_length + 2.0 * box_margin;
+    double width = box_width + 2.0 * domain_margin;
+    double length = box_length + 2.0 * domain_margin;
+
+    // Two material layers, the upper half with finer elements
+    int n_upper = bc.n_levels / 2, n_lower = bc.n_levels - n_upper;
+    double depth = n_upper * 0.5 + n_lower * 1.0;
+
+    ofstream input_file(input_filename.c_str());
+    input_file << setprecision(17);
+    input_file << "WIDTH " << width << "\nLENGTH " << length << "\nDEPTH " << depth << "\n";
+    input_file << "BOX " << domain_margin << " " << box_length << " " << box_width << "\n";
+    input_file << "ELEM_SIZE " << bc.elem_size_box << " " << bc.elem_size_corner << "\n";
+    input_file << "LAYER 0 " << n_upper << " 0.5\nLAYER 1 " << n_lower << " 1.0\n";
+
+    // Random fields jitter the grid positions by up to a third of the spacing, fixed seed
+    mt19937 generator(12345);
+    uniform_real_distribution<double> jitter(-spacing / 3.0, spacing / 3.0);
+    int number = 0;
+    for (int i = 0; i < bc.n_bhe_x; i++)
+    {
+        for (int j = 0; j < bc.n_bhe_y; j++)
+        {
+            double x = -field_width / 2.0 + i * spacing;
+            double y = domain_margin + box_margin + j * spacing;
+            if (bc.random_field)
+            {
+                x += jitter(generator);
+                y += jitter(generator);
+            }
+            input_file << "BHE " << number++ << " " << x << " " << y << " 0 " << -0.8 * depth << " 0.063\n";
+        }
+    }
+}
+
+// Binary GMSH msh2 file of the plane, as written by gmsh -format msh2 -bin
+static bool WriteBinaryMsh(const compact_mesh &plane, const string &mesh_filename)
+{
+    ofstream mesh_file(mesh_filename.c_str(), ios::binary);
+    int one = 1;
+
+    mesh_file << "$MeshFormat\n2.2 1 8\n";
+    mesh_file.write(reinterpret_cast<const char *>(&one), sizeof(one));
+    mesh_file << "\n$EndMeshFormat\n$Nodes\n" << plane.n_nodes() << "\n";
+    for (size_t i = 0; i < plane.n_nodes(); i++)
+    {
+        int number = static_cast<int>(i + 1);
+        double coords[3] = { plane.x[i], plane.y[i], plane.z[i] };
+        mesh_file.write(reinterpret_cast<const char *>(&number), sizeof(number));
+        mesh_file.write(reinterpret_cast<const char *>(coords), sizeof(coords));
+    }
+
+    int header[3] = { 2, static_cast<int>(plane.n_elements()), 2 };
+    mesh_file << "\n$EndNodes\n$Elements\n" << plane.n_elements() << "\n";
+    mesh_file.write(reinterpret_cast<const char *>(header), sizeof(header));
+    for (size_t i = 0; i < plane.n_elements(); i++)
+    {
+        const uint32_t *nodes = plane.element_nodes(i);
+        int values[6] = { static_cast<int>(i + 1), 0, 0, static_cast<int>(nodes[0] + 1), static_cast<int>(nodes[1] + 1), static_cast<int>(nodes[2] + 1) };
+        mesh_file.write(reinterpret_cast<const char *>(values), sizeof(values));
+    }
+    mesh_file << "\n$EndElements\n";
+
+    mesh_file.close();
+    return !mesh_file.fail();
+}
+
+// Best wall time of n_repeat runs; prepare runs untimed before every repetition
+static double TimeBest(int n_repeat, const function<void()> &prepare, const function<bool()> &run, bool &ok)
+{
+    double best = 0;
+    for (int r = 0; r < n_repeat; r++)
+    {
+        prepare();
+        double start = WallSeconds();
+        ok = run() && ok;
+        double elapsed = WallSeconds() - start;
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+static bool RunCase(const benchmark_case &bc, const string &work_directory, const int n_repeat, const int n_threads, vector<benchmark_result> &results)
+{
+    // Declarations
+    string project_name = (filesystem::path(work_directory) / bc.name).string();
+    string input_filename = project_name + ".inp";
+    geometry geom;
+    vector<layer> layers;
+    vector<bhe> BHEs;
+    vector<additional_point> add_points;
+    compact_mesh plane, patched_plane;
+    extruded_mesh mesh;
+    compact_mesh mesh_3D;
+    int cnt_mat_groups = 0;
+    bool ok = true;
+    double t;
+
+    auto add = [&](const char *stage, double seconds, uint64_t items, const char *item_name, uint64_t bytes) {
+        benchmark_result result = { bc.name, stage, seconds, items, item_name, bytes };
+        results.push_back(result);
+    };
+    auto nothing = []() {};
+
+    WriteSyntheticInput(bc, input_filename);
+
+    t = TimeBest(n_repeat, [&]() { geom = geometry(); layers.clear(); BHEs.clear(); add_points.clear(); },
+                 [&]() { string name = project_name; return ReadInputFile(input_filename, name, geom, layers, BHEs, add_points); }, ok);
+    add("ReadInputFile", t, BHEs.size(), "bhes", FileBytes(input_filename));
+
+    t = TimeBest(n_repeat, nothing, [&]() { return WriteGMSHgeo(project_name, geom, BHEs, add_points); }, ok);
+    add("WriteGMSHgeo", t, BHEs.size(), "bhes", FileBytes(project_name + ".geo"));
+
+    // Pre-generated 2D mesh, replaces running gmsh
+    t = TimeBest(n_repeat, nothing, [&]() { return MeshPlane(geom, BHEs, add_points, plane); }, ok);
+    add("MeshPlane", t, plane.n_elements(), "triangles", 0);
+    ok = WriteBinaryMsh(plane, project_name + ".msh") && ok;
+
+    // Random fields would fall back to MeshPlane
+    if (!bc.random_field)
+    {
+        t = TimeBest(n_repeat, nothing, [&]() { return MeshPlanePatched(geom, BHEs, add_points, patched_plane); }, ok);
+        add("MeshPlanePatched", t, patched_plane.n_elements(), "triangles", 0);
+    }
+
+    t = TimeBest(n_repeat, [&]() { mesh.plane.clear(); }, [&]() { return ImportGMSHmsh(project_name, mesh.plane); }, ok);
+    add("ImportGMSHmsh", t, mesh.plane.n_nodes() + mesh.plane.n_elements(), "entities", FileBytes(project_name + ".msh"));
+
+    t = TimeBest(n_repeat, nothing, [&]() { return ExtrudeMesh(mesh, layers, cnt_mat_groups); }, ok);
+    add("ExtrudeMesh", t, mesh.n_levels(), "levels", 0);
+
+    t = TimeBest(n_repeat, nothing, [&]() { return ComputeBHEelements(BHEs, mesh, geom.bhe_tolerance, cnt_mat_groups); }, ok);
+    add("ComputeBHEelements", t, mesh.n_bhe_elements(), "bhe_elements", 0);
+
+    t = TimeBest(n_repeat, nothing, [&]() { MaterializeMesh(mesh, mesh_3D, n_threads); return true; }, ok);
+    add("MaterializeMesh", t, mesh_3D.n_nodes() + mesh_3D.n_elements(), "entities", 0);
+
+    // Unchanged outputs are detected after writing, remove them so every repetition writes the same way
+    auto remove_output = [&](const string &filename) { return [filename]() { error_code error; filesystem::remove(filename, error); }; };
+
+    t = TimeBest(n_repeat, remove_output(project_name + ".bhe.msh"), [&]() { return WriteMesh(project_name, mesh, n_threads); }, ok);
+    add("WriteMesh", t, mesh.n_nodes() + mesh.n_elements(), "entities", FileBytes(project_name + ".bhe.msh"));
+
+    t = TimeBest(n_repeat, remove_output(project_name + ".vtu"), [&]() { return WriteVTU(project_name, mesh); }, ok);
+    add("WriteVTU", t, mesh.n_nodes() + mesh.n_elements(), "entities", FileBytes(project_name + ".vtu"));
+
+    t = TimeBest(n_repeat, remove_output(project_name + ".gli"), [&]() { return WriteGLI(project_name, geom, BHEs, add_points); }, ok);
+    add("WriteGLI", t, BHEs.size(), "bhes", FileBytes(project_name + ".gli"));
+
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    // Check input arguments
+    bool full_suite = false;
+    int n_repeat = 3;
+    int n_threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    string output_filename;
+    string work_directory = "bhe_benchmark_work";
+    bool args_ok = true;
+
+    for (int i = 1; i < argc && args_ok; i++)
+    {
+        if (string(argv[i]) == string("-suite") && i + 1 < argc)
+        {
+            string suite = argv[++i];
+            full_suite = (suite == string("full"));
+            args_ok = full_suite || suite == string("quick");
+        }
+        else if (string(argv[i]) == string("-repeat") && i + 1 < argc)
+            n_repeat = max(1, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-threads") && i + 1 < argc)
+            n_threads = max(1, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-output") && i + 1 < argc)
+            output_filename = argv[++i];
+        else if (string(argv[i]) == string("-workdir") && i + 1 < argc)
+            work_directory = argv[++i];
+        else
+            args_ok = false;
+    }
+
+    if (!args_ok)
+    {
+        cout << "Usage: bhe_benchmark (-suite quick|full) (-repeat n) (-threads n) (-output file.csv) (-workdir directory)" << endl;
+        return 1;
+    }
+
+    filesystem::create_directories(work_directory);
+
+    // The stages report every step, keep the console for the results
+    vector<benchmark_result> results;
+    bool ok = true;
+    stringstream stage_log;
+    streambuf *console = cout.rdbuf(stage_log.rdbuf());
+
+    for (const benchmark_case &bc : benchmark_cases)
+    {
+        if (bc.full_only && !full_suite)
+            continue;
+        if (!RunCase(bc, work_directory, n_repeat, n_threads, results))
+            ok = false;
+        stage_log.str("");
+    }
+
+    cout.rdbuf(console);
+
+    // Results table, best of n_repeat
+    stringstream table;
+    table << "case,stage,seconds,items,item,items_per_s,mb,mb_per_s" << endl;
+    for (const benchmark_result &r : results)
+    {
+        double mb = r.bytes / 1.0e6;
+        table << r.case_name << "," << r.stage << "," << r.seconds << "," << r.items << "," << r.item_name << ","
+              << (r.seconds > 0 ? r.items / r.seconds : 0) << "," << mb << "," << (r.seconds > 0 ? mb / r.seconds : 0) << endl;
+    }
+    cout << table.str();
+
+    if (!output_filename.empty())
+    {
+        ofstream output_file(output_filename.c_str());
+        output_file << "# bhe_benchmark, threads " << n_threads << ", repeat " << n_repeat << ", suite " << (full_suite ? "full" : "quick") << endl;
+        output_file << table.str();
+    }
+
+    if (!ok)
+    {
+        cout << "Error: Some benchmark stages failed!" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,280 @@
+#include "pch.h"
+#include "batch.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "mesh_cache.h"
+
+using namespace std;
+
+struct batch_job
+{
+    string input_filename;
+    string variant;
+};
+
+struct sweep_parameter
+{
+    string name;
+    vector<string> values;
+};
+
+static vector<string> SplitWords(const string &line)
+{
+    vector<string> words;
+    istringstream stream(line);
+    string word;
+    while (stream >> word)
+        words.push_back(word);
+    return words;
+}
+
+static string ReplaceAll(string text, const string &pattern, const string &value)
+{
+    for (size_t pos = text.find(pattern); pos != string::npos; pos = text.find(pattern, pos + value.size()))
+        text.replace(pos, pattern.size(), value);
+    return text;
+}
+
+// Writes one input file per combination of the parameter values
+// Variants are numbered by n_variants_written, which runs on over all sweeps of the batch
+static bool ExpandSweep(const string &template_filename, const vector<sweep_parameter> &parameters, size_t &n_variants_written, vector<batch_job> &jobs)
+{
+    ifstream template_file(template_filename.c_str());
+    if (!template_file.is_open())
+    {
+        cout << "Error: Couldn't open sweep template " << template_filename << "!" << endl;
+        return false;
+    }
+
+    // Variants are named after their input file, so the template's project name is dropped
+    string text, line;
+    while (getline(template_file, line))
+    {
+        vector<string> words = SplitWords(line);
+        if (!words.empty() && words[0] == string("PROJECT"))
+            continue;
+        text.append(line).append("\n");
+    }
+
+    size_t n_variants = 1;
+    for (const sweep_parameter &parameter : parameters)
+    {
+        if (text.find("{" + parameter.name + "}") == string::npos)
+            cout << "Warning: Sweep parameter " << parameter.name << " is not used in " << template_filename << "!" << endl;
+        n_variants *= parameter.values.size();
+    }
+
+    string base_name = template_filename;
+    base_name.erase(base_name.end() - 4, base_name.end());
+
+    for (size_t k = 0; k < n_variants; k++)
+    {
+        batch_job job;
+        string variant_text = text;
+        size_t index = k;
+
+        // Mixed radix: the last parameter varies fastest
+        for (size_t p = parameters.size(); p-- > 0;)
+        {
+            const string &value = parameters[p].values[index % parameters[p].values.size()];
+            index /= parameters[p].values.size();
+
+            variant_text = ReplaceAll(variant_text, "{" + parameters[p].name + "}", value);
+            job.variant = parameters[p].name + "=" + value + (job.variant.empty() ? "" : " ") + job.variant;
+        }
+
+        job.input_filename = base_name + "_" + to_string(++n_variants_written) + ".inp";
+        replacing_ofstream variant_file(job.input_filename, false);
+        variant_file << variant_text;
+
+        bool changed;
+        if (!variant_file.commit(changed))
+        {
+            cout << "Error: Couldn't write sweep input " << job.input_filename << "!" << endl;
+            return false;
+        }
+
+        jobs.push_back(job);
+    }
+
+    return true;
+}
+
+static bool ReadBatchFile(const string &batch_filename, vector<batch_job> &jobs)
+{
+    ifstream batch_file(batch_filename.c_str());
+    string line;
+    string template_filename;
+    vector<sweep_parameter> parameters;
+    size_t n_variants_written = 0;
+    bool in_sweep = false;
+
+    if (!batch_file.is_open())
+    {
+        cout << "Error: Couldn't open batch file " << batch_filename << "!" << endl;
+        return false;
+    }
+
+    while (getline(batch_file, line))
+    {
+        vector<string> words = SplitWords(line);
+        if (words.empty() || words[0].compare(0, 2, "//") == 0)
+            continue;
+
+        if (words[0] == string("SWEEP") && words.size() == 2 && !in_sweep)
+        {
+            in_sweep = true;
+            template_filename = words[1];
+            parameters.clear();
+        }
+        else if (words[0] == string("PARAM") && words.size() >= 3 && in_sweep)
+        {
+            sweep_parameter parameter;
+            parameter.name = words[1];
+            parameter.values.assign(words.begin() + 2, words.end());
+            parameters.push_back(parameter);
+        }
+        else if (words[0] == string("END") && in_sweep)
+        {
+            in_sweep = false;
+            if (!ExpandSweep(template_filename, parameters, n_variants_written, jobs))
+                return false;
+        }
+        else if (words.size() == 1 && !in_sweep)
+        {
+            batch_job job;
+            job.input_filename = words[0];
+            jobs.push_back(job);
+        }
+        else
+        {
+            cout << "Error: Couldn't understand batch command " << line << "!" << endl;
+            return false;
+        }
+    }
+
+    if (in_sweep)
+    {
+        cout << "Error: Missing END of sweep " << template_filename << "!" << endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Project name a run of the input writes its outputs to: the input name without .inp, unless set by PROJECT
+static string ProjectName(const string &input_filename)
+{
+    ifstream input_file(input_filename.c_str());
+    string line;
+    string project_name = input_filename.size() > 4 ? input_filename.substr(0, input_filename.size() - 4) : input_filename;
+
+    while (getline(input_file, line))
+    {
+        vector<string> words = SplitWords(line);
+        if (words.size() >= 2 && words[0] == string("PROJECT"))
+            project_name = words[1];
+    }
+    return project_name;
+}
+
+// Concurrent runs writing the same outputs would overwrite each other
+static bool CheckProjectNames(const vector<batch_job> &jobs)
+{
+    map<string, size_t> first_job;
+    bool ok = true;
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        auto inserted = first_job.insert(make_pair(ProjectName(jobs[i].input_filename), i));
+        if (!inserted.second)
+        {
+            cout << "Error: " << jobs[i].input_filename << " and " << jobs[inserted.first->second].input_filename
+                 << " both write project " << inserted.first->first << "!" << endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool WriteSummary(const string &summary_filename, const vector<batch_job> &jobs, const vector<run_statistics> &stats)
+{
+    ofstream summary_file(summary_filename.c_str());
+    if (!summary_file.is_open())
+    {
+        cout << "Error: Couldn't open batch summary " << summary_filename << "!" << endl;
+        return false;
+    }
+
+    summary_file << "input,variant,ok,plane_nodes,plane_elements,nodes,elements,time_read,time_plane,time_extrude,time_write,time_total" << endl;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const run_statistics &s = stats[i];
+        summary_file << jobs[i].input_filename << "," << jobs[i].variant << "," << (s.ok ? 1 : 0) << ","
+                     << s.n_plane_nodes << "," << s.n_plane_elements << "," << s.n_nodes << "," << s.n_elements << ","
+                     << s.time_read << "," << s.time_plane << "," << s.time_extrude << "," << s.time_write << "," << s.time_total << endl;
+    }
+
+    summary_file.close();
+    return !summary_file.fail();
+}
+
+bool RunBatch(const string &batch_filename, const run_options &options, const int n_jobs, const int n_gmsh_processes, const size_t memory_megabytes)
+{
+    // Declarations
+    vector<batch_job> jobs;
+    shared_planes planes(memory_megabytes << 20);
+    process_limit gmsh_processes(n_gmsh_processes);
+    run_context context;
+    atomic<size_t> next_job(0);
+
+    if (!ReadBatchFile(batch_filename, jobs) || !CheckProjectNames(jobs))
+        return false;
+
+    vector<run_statistics> stats(jobs.size());
+    context.planes = &planes;
+    context.gmsh_processes = &gmsh_processes;
+
+    // The threads of a run are shared out between the concurrent runs
+    size_t n_workers = min<size_t>(max(1, n_jobs), jobs.size());
+    run_options job_options = options;
+    job_options.n_threads = max(1, options.n_threads / max(1, static_cast<int>(n_workers)));
+
+    cout << "Running " << jobs.size() << " inputs on " << n_workers << " threads..." << endl;
+
+    vector<thread> workers;
+    for (size_t k = 0; k < n_workers; k++)
+    {
+        workers.emplace_back([&]() {
+            for (size_t i = next_job++; i < jobs.size(); i = next_job++)
+            {
+                if (!RunPipeline(jobs[i].input_filename, job_options, context, stats[i]))
+                    cout << "Error: Run " << jobs[i].input_filename << " failed!" << endl;
+            }
+        });
+    }
+    for (thread &worker : workers)
+        worker.join();
+
+    size_t n_ok = count_if(stats.begin(), stats.end(), [](const run_statistics &s) { return s.ok; });
+
+    string summary_filename = batch_filename;
+    size_t dot = summary_filename.find_last_of('.');
+    if (dot != string::npos && summary_filename.find_first_of("/\\", dot) == string::npos)
+        summary_filename.erase(dot);
+    summary_filename.append("_summary.csv");
+
+    if (!WriteSummary(summary_filename, jobs, stats))
+        return false;
+
+    cout << "Batch finished: " << n_ok << " of " << jobs.size() << " runs successful, summary written to " << summary_filename << "..." << endl;
+    return n_ok == jobs.size();
+}
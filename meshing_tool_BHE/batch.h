@@ -0,0 +1,23 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <cstddef>
+#include <string>
+
+#include "pipeline.h"
+
+// Batch mode: runs the pipeline for many inputs on a pool of n_jobs threads
+// The batch file lists input files, one per line, and parameter sweeps:
+//   SWEEP template.inp
+//   PARAM name value_1 value_2 ...
+//   END
+// A sweep writes template_1.inp, template_2.inp, ... for all combinations of the values,
+// with {name} in the template replaced by the value. PROJECT lines of the template are dropped.
+// The variant numbers run on over all sweeps, so sweeps of the same template don't share files.
+// Inputs resolving to the same project name are rejected before any run starts.
+// Runs with the same 2D inputs share one plane, finished planes are kept up to memory_megabytes (least recently used dropped).
+// At most n_gmsh_processes gmsh instances run at a time.
+// Counts and stage timings are written to <batch>_summary.csv.
+bool RunBatch(const std::string &batch_filename, const run_options &options, const int n_jobs, const int n_gmsh_processes, const size_t memory_megabytes);
+
+#endif //BATCH_H
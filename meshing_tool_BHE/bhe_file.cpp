@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "bhe_file.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "mapped_file.h"
+#include "spatial_hash.h"
+
+using namespace std;
+
+static bool IsSeparator(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == ',' || c == ';';
+}
+
+template <typename T>
+static bool ParseField(const char *&pos, const char *end, T &value)
+{
+    while (pos < end && IsSeparator(*pos))
+        pos++;
+    if (pos < end && *pos == '+')
+        pos++;
+    from_chars_result result = from_chars(pos, end, value);
+    if (result.ec != errc() || (result.ptr < end && !IsSeparator(*result.ptr)))
+        return false;
+    pos = result.ptr;
+    return true;
+}
+
+bool ReadBHEfile(const string &filename, vector<bhe> &BHEs, uint64_t *bytes_read)
+{
+    mapped_file file;
+
+    if (!file.open(filename))
+    {
+        cout << "Error: Couldn't open BHE file " << filename << "!" << endl;
+        return false;
+    }
+
+    const char *pos = file.begin();
+    const char *end = file.end();
+    size_t line_number = 0, n_read = 0;
+    bool first_line = true;
+
+    while (pos < end)
+    {
+        const char *eol = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        const char *line_end = (eol == nullptr) ? end : eol;
+        line_number++;
+
+        const char *field = pos;
+        while (field < line_end && IsSeparator(*field))
+            field++;
+
+        if (field < line_end && *field != '#')
+        {
+            bhe this_BHE;
+            const char *p = field;
+            bool ok = ParseField(p, line_end, this_BHE.bhe_number) && ParseField(p, line_end, this_BHE.bhe_x) && ParseField(p, line_end, this_BHE.bhe_y) &&
+                      ParseField(p, line_end, this_BHE.bhe_top) && ParseField(p, line_end, this_BHE.bhe_bottom) && ParseField(p, line_end, this_BHE.bhe_radius);
+            while (ok && p < line_end && IsSeparator(*p))
+                p++;
+
+            if (ok && p == line_end)
+            {
+                BHEs.push_back(this_BHE);
+                n_read++;
+            }
+            else if (!(first_line && !isdigit(static_cast<unsigned char>(*field)) && *field != '-' && *field != '+' && *field != '.'))
+            {
+                cout << "Error: Couldn't read BHE in line " << line_number << " of " << filename << "!" << endl;
+                return false;
+            }
+            first_line = false;
+        }
+
+        pos = (eol == nullptr) ? end : eol + 1;
+    }
+
+    if (bytes_read)
+        *bytes_read += file.size();
+    cout << "Reading " << n_read << " BHEs from " << filename << " successful..." << endl;
+    return true;
+}
+
+bool CheckBHEs(const vector<bhe> &BHEs)
+{
+    bool ok = true;
+
+    // Duplicate numbers: neighbours after sorting
+    vector<int> numbers(BHEs.size());
+    for (size_t i = 0; i < BHEs.size(); i++)
+        numbers[i] = BHEs[i].bhe_number;
+    sort(numbers.begin(), numbers.end());
+    for (size_t i = 1; i < numbers.size(); i++)
+        if (numbers[i] == numbers[i - 1] && (i == 1 || numbers[i - 2] != numbers[i]))
+        {
+            cout << "Error: BHE #" << numbers[i] << " is defined more than once!" << endl;
+            ok = false;
+        }
+
+    // Overlapping hexagons: centers closer than the sum of the hexagon sizes
+    double max_delta = 0;
+    for (size_t i = 0; i < BHEs.size(); i++)
+        max_delta = max(max_delta, bhe_alpha * BHEs[i].bhe_radius);
+    if (max_delta <= 0)
+        return ok;
+
+    spatial_hash centers(2 * max_delta);
+    centers.reserve(BHEs.size());
+    for (size_t i = 0; i < BHEs.size(); i++)
+        centers.add(BHEs[i].bhe_x, BHEs[i].bhe_y);
+    centers.build();
+
+    vector<int> close;
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        double delta = bhe_alpha * BHEs[i].bhe_radius;
+        close.clear();
+        centers.within(BHEs[i].bhe_x, BHEs[i].bhe_y, delta + max_delta, close);
+        for (int j : close)
+        {
+            if (j <= static_cast<int>(i))
+                continue;
+            double distance = hypot(BHEs[j].bhe_x - BHEs[i].bhe_x, BHEs[j].bhe_y - BHEs[i].bhe_y);
+            if (distance < delta + bhe_alpha * BHEs[j].bhe_radius)
+            {
+                cout << "Error: BHE #" << BHEs[i].bhe_number << " and BHE #" << BHEs[j].bhe_number << " overlap (distance " << distance << ")!" << endl;
+                ok = false;
+            }
+        }
+    }
+
+    return ok;
+}
@@ -0,0 +1,18 @@
+#ifndef BHE_FILE_H
+#define BHE_FILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "meshing_tool_BHE.h"
+
+// Bulk BHE input (BHE_FILE): one BHE per line as number, x, y, z_top, z_bottom, radius,
+// separated by commas, semicolons or blanks. A header line, blank lines and lines
+// starting with # are skipped. The file is parsed in place from a memory mapping, its size is added to bytes_read.
+bool ReadBHEfile(const std::string &filename, std::vector<bhe> &BHEs, uint64_t *bytes_read = nullptr);
+
+// Checks for duplicate BHE numbers and for BHEs whose hexagons overlap
+bool CheckBHEs(const std::vector<bhe> &BHEs);
+
+#endif //BHE_FILE_H
@@ -0,0 +1,73 @@
+#include "pch.h"
+#include "bhe_mesh_api.h"
+
+#include <iostream>
+
+#include "instrumentation.h"
+#include "msh_writer.h"
+#include "vtu_writer.h"
+
+using namespace std;
+
+mesh_view mesh_result::view() const
+{
+    mesh_view result;
+    result.x = explicit_mesh.x;
+    result.y = explicit_mesh.y;
+    result.z = explicit_mesh.z;
+    result.connectivity = explicit_mesh.connectivity;
+    result.blocks = explicit_mesh.blocks;
+    result.material_groups = explicit_mesh.material_groups;
+    result.bhe_elements = bhe_elements;
+    return result;
+}
+
+bool GenerateMesh(const model_description &model, const run_options &options, mesh_result &result)
+{
+    run_options mesh_options = options;
+    mesh_options.native_mesher = true;
+    mesh_options.recombine_quads = false;
+    mesh_options.gmsh_only = false;
+    mesh_options.write_gli = false;
+
+    // Stages are timed as usual, the report isn't written
+    run_report report;
+    result = mesh_result();
+    if (!BuildMesh(string(), model, mesh_options, run_context(), result.mesh, result.stats, report))
+        return false;
+
+    MaterializeMesh(result.mesh, result.explicit_mesh, options.n_threads);
+
+    // The lines of a BHE are consecutive after the prisms
+    const extruded_mesh &mesh = result.mesh;
+    result.bhe_elements.assign(model.BHEs.size(), bhe_element_range());
+    for (size_t line = 0; line < mesh.n_bhe_elements(); line++)
+    {
+        size_t i = mesh.bhe_of_line(line);
+        if (i >= result.bhe_elements.size())
+            continue;
+        if (result.bhe_elements[i].count == 0)
+            result.bhe_elements[i].first = mesh.n_prisms() + line;
+        result.bhe_elements[i].count++;
+    }
+
+    result.stats.ok = true;
+    return true;
+}
+
+bool ReadModel(const string &input_filename, string &project_name, model_description &model)
+{
+    model = model_description();
+    return ReadInputFile(input_filename, project_name, model.geom, model.layers, model.BHEs, model.add_points);
+}
+
+bool WriteModelMesh(const string &project_name, const model_description &model, const mesh_result &result, const run_options &options)
+{
+    if (options.write_gli && !WriteGLI(project_name, model.geom, model.BHEs, model.add_points))
+        return false;
+    if (options.write_msh && !WriteMesh(project_name, result.explicit_mesh, options.n_threads))
+        return false;
+    if (options.write_vtu && !WriteVTU(project_name, result.explicit_mesh))
+        return false;
+    return true;
+}
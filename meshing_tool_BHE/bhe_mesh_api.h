@@ -0,0 +1,68 @@
+#ifndef BHE_MESH_API_H
+#define BHE_MESH_API_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "meshing_tool_BHE.h"
+#include "pipeline.h"
+
+// Embeddable meshing: a model_description in memory is meshed with the built-in mesher,
+// without input files, gmsh processes or mesh outputs. Reading the .inp file and writing
+// the .bhe.msh/.vtu/.gli files are optional adapters around it.
+
+// Read-only view of a contiguous array owned by a mesh_result
+template <typename T>
+struct array_view
+{
+    const T *data = nullptr;
+    size_t size = 0;
+
+    array_view() = default;
+    array_view(const std::vector<T> &values) : data(values.data()), size(values.size()) {}
+
+    const T &operator[](size_t i) const { return data[i]; }
+    const T *begin() const { return data; }
+    const T *end() const { return data + size; }
+};
+
+// Line elements of one BHE are elements first .. first + count - 1 of the 3D mesh
+struct bhe_element_range
+{
+    size_t first = 0, count = 0;
+};
+
+// 3D mesh: prisms (6 nodes each) followed by the BHE lines (2 nodes each), see blocks
+struct mesh_view
+{
+    array_view<double> x, y, z;
+    array_view<uint32_t> connectivity;
+    array_view<element_block> blocks;
+    array_view<uint16_t> material_groups;
+    array_view<bhe_element_range> bhe_elements;     // one per BHE of the model
+};
+
+// Owns all buffers of a generated mesh, views stay valid while it is unchanged
+struct mesh_result
+{
+    extruded_mesh mesh;             // structured mesh, 3D entities computed on access
+    compact_mesh explicit_mesh;     // materialized 3D mesh
+    std::vector<bhe_element_range> bhe_elements;
+    run_statistics stats;
+
+    mesh_view view() const;
+};
+
+// Meshes the model with the options of the command line, except that the built-in mesher
+// is always used (-mesher patch is honored, -quads is not) and no files are written (the cache is, if set)
+bool GenerateMesh(const model_description &model, const run_options &options, mesh_result &result);
+
+// File adapters: the .inp input and the outputs selected by write_msh, write_vtu and write_gli
+bool ReadModel(const std::string &input_filename, std::string &project_name, model_description &model);
+bool WriteModelMesh(const std::string &project_name, const model_description &model, const mesh_result &result, const run_options &options);
+
+#endif //BHE_MESH_API_H
@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "boundary.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <tuple>
+
+#include "mesh_cache.h"
+#include "text_output.h"
+
+using namespace std;
+
+const char *const boundary_names[n_boundary_surfaces] = { "top", "bottom", "left", "right", "inflow", "outflow" };
+
+enum boundary_surface
+{
+    surface_top,
+    surface_bottom,
+    surface_left,
+    surface_right,
+    surface_inflow,
+    surface_outflow
+};
+
+// Buffered text is flushed to the file beyond this size
+static const size_t flush_size = 1 << 20;
+
+void FindBoundaryEdges(const compact_mesh &plane, vector<plane_edge> &edges)
+{
+    // All element edges sorted by their node pair, edges occurring once are on the boundary
+    vector<tuple<uint32_t, uint32_t, uint32_t, uint8_t>> all_edges;    // low node, high node, element, position
+    all_edges.reserve(plane.n_connectivity());
+    for (size_t e = 0; e < plane.n_elements(); e++)
+    {
+        mesh_element face = plane.element_at(e);
+        for (int k = 0; k < face.n_nodes; k++)
+        {
+            uint32_t a = face.nodes[k], b = face.nodes[(k + 1) % face.n_nodes];
+            all_edges.emplace_back(min(a, b), max(a, b), static_cast<uint32_t>(e), static_cast<uint8_t>(k));
+        }
+    }
+    sort(all_edges.begin(), all_edges.end());
+
+    edges.clear();
+    for (size_t i = 0; i < all_edges.size(); i++)
+    {
+        bool shared = (i > 0 && get<0>(all_edges[i - 1]) == get<0>(all_edges[i]) && get<1>(all_edges[i - 1]) == get<1>(all_edges[i])) ||
+                      (i + 1 < all_edges.size() && get<0>(all_edges[i + 1]) == get<0>(all_edges[i]) && get<1>(all_edges[i + 1]) == get<1>(all_edges[i]));
+        if (shared)
+            continue;
+
+        plane_edge edge;
+        edge.element = get<2>(all_edges[i]);
+        const uint32_t *nodes = plane.element_nodes(edge.element);
+        int k = get<3>(all_edges[i]), n = NodesPerElement(plane.block_of(edge.element).type);
+        edge.nodes[0] = nodes[k];
+        edge.nodes[1] = nodes[(k + 1) % n];
+        edges.push_back(edge);
+    }
+
+    sort(edges.begin(), edges.end(), [](const plane_edge &a, const plane_edge &b) { return a.element < b.element; });
+}
+
+// Top or bottom: the plane elements on one level, as faces of the elements of the adjacent element level
+static void AddLevelFaces(const extruded_mesh &mesh, size_t level, size_t element_level, boundary_set &set)
+{
+    vector<char> referenced(mesh.n_nodes_in_plane(), 0);
+    for (size_t e = 0; e < mesh.n_elems_in_plane(); e++)
+    {
+        mesh_element face = mesh.plane.element_at(e);
+        set.face_elements.push_back(mesh.prism_index(element_level, e));
+        set.face_types.push_back(face.type);
+        for (int k = 0; k < face.n_nodes; k++)
+        {
+            set.face_connectivity.push_back(mesh.node_index(level, face.nodes[k]));
+            referenced[face.nodes[k]] = 1;
+        }
+    }
+
+    for (size_t n = 0; n < referenced.size(); n++)
+        if (referenced[n])
+            set.nodes.push_back(mesh.node_index(level, n));
+}
+
+bool ComputeBoundarySets(const extruded_mesh &mesh, const geometry &geom, const double tolerance, vector<boundary_set> &sets)
+{
+    size_t n_element_levels = mesh.n_element_levels();
+    const compact_mesh &plane = mesh.plane;
+
+    sets.assign(n_boundary_surfaces, boundary_set());
+    if (n_element_levels == 0 || mesh.n_elems_in_plane() == 0)
+    {
+        cout << "Error: Can't compute boundary sets of a mesh without prisms!" << endl;
+        return false;
+    }
+
+    AddLevelFaces(mesh, 0, 0, sets[surface_top]);
+    AddLevelFaces(mesh, n_element_levels, n_element_levels - 1, sets[surface_bottom]);
+
+    // Sides of the plane boundary, edges along the domain boundary only
+    vector<plane_edge> edges;
+    FindBoundaryEdges(plane, edges);
+
+    auto on_side = [&](const plane_edge &edge, int side) {
+        double x0 = plane.x[edge.nodes[0]], y0 = plane.y[edge.nodes[0]], x1 = plane.x[edge.nodes[1]], y1 = plane.y[edge.nodes[1]];
+        switch (side)
+        {
+        case surface_left:
+            return fabs(x0 + geom.width / 2) <= tolerance && fabs(x1 + geom.width / 2) <= tolerance;
+        case surface_right:
+            return fabs(x0 - geom.width / 2) <= tolerance && fabs(x1 - geom.width / 2) <= tolerance;
+        case surface_inflow:
+            return fabs(y0) <= tolerance && fabs(y1) <= tolerance;
+        case surface_outflow:
+            return fabs(y0 - geom.length) <= tolerance && fabs(y1 - geom.length) <= tolerance;
+        }
+        return false;
+    };
+
+    size_t n_unassigned = 0;
+    vector<vector<plane_edge>> side_edges(n_boundary_surfaces);
+    for (const plane_edge &edge : edges)
+    {
+        bool assigned = false;
+        for (int side = surface_left; side <= surface_outflow; side++)
+            if (on_side(edge, side))
+            {
+                side_edges[side].push_back(edge);
+                assigned = true;
+                break;
+            }
+        n_unassigned += assigned ? 0 : 1;
+    }
+
+    for (int side = surface_left; side <= surface_outflow; side++)
+    {
+        boundary_set &set = sets[side];
+
+        // Quadrilateral faces: the edge on the upper level, then back on the lower level
+        for (size_t level = 0; level < n_element_levels; level++)
+            for (const plane_edge &edge : side_edges[side])
+            {
+                set.face_elements.push_back(mesh.prism_index(level, edge.element));
+                set.face_types.push_back(element_type::quad);
+                set.face_connectivity.push_back(mesh.node_index(level, edge.nodes[0]));
+                set.face_connectivity.push_back(mesh.node_index(level, edge.nodes[1]));
+                set.face_connectivity.push_back(mesh.node_index(level + 1, edge.nodes[1]));
+                set.face_connectivity.push_back(mesh.node_index(level + 1, edge.nodes[0]));
+            }
+
+        vector<uint32_t> plane_nodes;
+        for (const plane_edge &edge : side_edges[side])
+            plane_nodes.insert(plane_nodes.end(), edge.nodes, edge.nodes + 2);
+        sort(plane_nodes.begin(), plane_nodes.end());
+        plane_nodes.erase(unique(plane_nodes.begin(), plane_nodes.end()), plane_nodes.end());
+
+        for (size_t level = 0; level <= n_element_levels; level++)
+            for (uint32_t n : plane_nodes)
+                set.nodes.push_back(mesh.node_index(level, n));
+        // Column-major numbering interleaves the levels
+        if (mesh.column_major)
+            sort(set.nodes.begin(), set.nodes.end());
+    }
+
+    if (n_unassigned > 0)
+        cout << "Warning: " << n_unassigned << " boundary edges of the 2D mesh are not on the model boundary!" << endl;
+
+    cout << "Boundary sets computed from " << edges.size() - n_unassigned << " boundary edges of the 2D mesh..." << endl;
+    return true;
+}
+
+static void Flush(ostream &out, text_buffer &buffer, bool force)
+{
+    if (force || buffer.size() >= flush_size)
+    {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+bool WriteBoundarySets(const string project_name, const vector<boundary_set> &sets, uint64_t *bytes_written)
+{
+    string boundary_filename = project_name + ".boundary";
+    replacing_ofstream boundary_file(boundary_filename);
+    text_buffer buffer;
+    bool changed;
+
+    if (!boundary_file.is_open())
+    {
+        cout << "Error: Couldn't open boundary file!" << endl;
+        return false;
+    }
+
+    for (size_t s = 0; s < sets.size() && s < static_cast<size_t>(n_boundary_surfaces); s++)
+    {
+        const boundary_set &set = sets[s];
+        buffer.put("#BOUNDARY\n$NAME\n").put(boundary_names[s]).put('\n');
+
+        buffer.put("$NODES\n").put(set.nodes.size()).put('\n');
+        for (uint32_t node : set.nodes)
+        {
+            buffer.put(node).put('\n');
+            Flush(boundary_file, buffer, false);
+        }
+
+        // Faces: element type nodes
+        buffer.put("$FACES\n").put(set.face_elements.size()).put('\n');
+        const uint32_t *nodes = set.face_connectivity.data();
+        for (size_t f = 0; f < set.face_elements.size(); f++)
+        {
+            buffer.put(set.face_elements[f]).put(' ').put(ElementTypeName(set.face_types[f]));
+            for (int k = 0; k < NodesPerElement(set.face_types[f]); k++)
+                buffer.put(' ').put(*nodes++);
+            buffer.put('\n');
+            Flush(boundary_file, buffer, false);
+        }
+    }
+    buffer.put("#STOP\n");
+    Flush(boundary_file, buffer, true);
+
+    // Unchanged files are not rewritten
+    if (!boundary_file.commit(changed))
+    {
+        cout << "Error: Couldn't write boundary file " << boundary_filename << "!" << endl;
+        return false;
+    }
+    if (bytes_written)
+        *bytes_written += boundary_file.bytes_written();
+
+    if (changed)
+        cout << "Write boundary sets to " << boundary_filename << " successful..." << endl;
+    else
+        cout << "Boundary file " << boundary_filename << " is unchanged..." << endl;
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef BOUNDARY_H
+#define BOUNDARY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "meshing_tool_BHE.h"
+
+// Boundary surfaces of the extruded box, named as the surfaces of the .gli:
+// top and bottom are the first and last level, left/right at x = -/+ width/2, inflow/outflow at y = 0/length
+const int n_boundary_surfaces = 6;
+extern const char *const boundary_names[n_boundary_surfaces];
+
+// Edge used by one plane element only, nodes in the order of that element
+struct plane_edge
+{
+    uint32_t nodes[2];
+    uint32_t element;
+};
+
+// Nodes and faces of one surface, each face is a side of one 3D element (tri or quad)
+struct boundary_set
+{
+    std::vector<uint32_t> nodes;                // ascending
+    std::vector<size_t> face_elements;
+    std::vector<element_type> face_types;
+    std::vector<uint32_t> face_connectivity;    // nodes of the faces in sequence
+};
+
+// Boundary edges of the plane, ordered by element
+void FindBoundaryEdges(const compact_mesh &plane, std::vector<plane_edge> &edges);
+
+// Sets of the six surfaces from the structured extrusion: top and bottom faces are the plane
+// elements on the first and last level, side faces are the boundary edges times the element levels.
+// Boundary edges are assigned to a side if both nodes are within tolerance of it.
+bool ComputeBoundarySets(const extruded_mesh &mesh, const geometry &geom, const double tolerance, std::vector<boundary_set> &sets);
+
+// Writes <project_name>.boundary: per surface its name, node indices and faces (element, type, nodes)
+bool WriteBoundarySets(const std::string project_name, const std::vector<boundary_set> &sets, uint64_t *bytes_written = nullptr);
+
+#endif //BOUNDARY_H
@@ -0,0 +1,153 @@
+#include "pch.h"
+#include "compact_mesh.h"
+
+#include <algorithm>
+
+using namespace std;
+
+int NodesPerElement(element_type type)
+{
+    switch (type)
+    {
+    case element_type::line:
+        return 2;
+    case element_type::tri:
+        return 3;
+    case element_type::pris:
+        return 6;
+    case element_type::quad:
+        return 4;
+    case element_type::hex:
+        return 8;
+    }
+    return 0;
+}
+
+const char *ElementTypeName(element_type type)
+{
+    switch (type)
+    {
+    case element_type::line:
+        return "line";
+    case element_type::tri:
+        return "tri";
+    case element_type::pris:
+        return "pris";
+    case element_type::quad:
+        return "quad";
+    case element_type::hex:
+        return "hex";
+    }
+    return "";
+}
+
+void compact_mesh::clear()
+{
+    x.clear();
+    y.clear();
+    z.clear();
+    connectivity.clear();
+    blocks.clear();
+    material_groups.clear();
+}
+
+void compact_mesh::reserve(size_t n_nodes, size_t n_elements, size_t n_connectivity)
+{
+    x.reserve(n_nodes);
+    y.reserve(n_nodes);
+    z.reserve(n_nodes);
+    material_groups.reserve(n_elements);
+    connectivity.reserve(n_connectivity);
+}
+
+uint32_t compact_mesh::add_node(double node_x, double node_y, double node_z)
+{
+    x.push_back(node_x);
+    y.push_back(node_y);
+    z.push_back(node_z);
+    return static_cast<uint32_t>(x.size() - 1);
+}
+
+size_t compact_mesh::add_element(element_type type, const uint32_t *nodes, uint16_t material_group)
+{
+    // Continue the last block or start a new one
+    if (blocks.empty() || blocks.back().type != type)
+    {
+        element_block block;
+        block.type = type;
+        block.first_element = n_elements();
+        block.n_elements = 0;
+        block.first_connectivity = connectivity.size();
+        blocks.push_back(block);
+    }
+
+    connectivity.insert(connectivity.end(), nodes, nodes + NodesPerElement(type));
+    material_groups.push_back(material_group);
+    blocks.back().n_elements++;
+
+    return n_elements() - 1;
+}
+
+void compact_mesh::resize_nodes(size_t n_nodes)
+{
+    x.resize(n_nodes);
+    y.resize(n_nodes);
+    z.resize(n_nodes);
+}
+
+size_t compact_mesh::add_block(element_type type, size_t n_elements)
+{
+    element_block block;
+    block.type = type;
+    block.first_element = this->n_elements();
+    block.n_elements = n_elements;
+    block.first_connectivity = connectivity.size();
+    blocks.push_back(block);
+
+    connectivity.resize(connectivity.size() + n_elements * NodesPerElement(type));
+    material_groups.resize(material_groups.size() + n_elements);
+
+    return blocks.size() - 1;
+}
+
+const element_block &compact_mesh::block_of(size_t element) const
+{
+    // Few blocks, the last one is the most likely
+    if (blocks.back().first_element <= element)
+        return blocks.back();
+
+    auto it = upper_bound(blocks.begin(), blocks.end(), element, [](size_t value, const element_block &block) { return value < block.first_element; });
+    return *(it - 1);
+}
+
+const uint32_t *compact_mesh::element_nodes(size_t element) const
+{
+    const element_block &block = block_of(element);
+    return connectivity.data() + block.first_connectivity + (element - block.first_element) * NodesPerElement(block.type);
+}
+
+mesh_node compact_mesh::node_at(size_t index) const
+{
+    mesh_node this_node;
+    this_node.index = index;
+    this_node.x = x[index];
+    this_node.y = y[index];
+    this_node.z = z[index];
+    return this_node;
+}
+
+mesh_element compact_mesh::element_at(size_t index) const
+{
+    const element_block &block = block_of(index);
+
+    mesh_element this_element;
+    this_element.index = index;
+    this_element.type = block.type;
+    this_element.material_group = material_groups[index];
+    this_element.n_nodes = NodesPerElement(block.type);
+
+    const uint32_t *nodes = connectivity.data() + block.first_connectivity + (index - block.first_element) * this_element.n_nodes;
+    copy(nodes, nodes + this_element.n_nodes, this_element.nodes);
+
+    return this_element;
+}
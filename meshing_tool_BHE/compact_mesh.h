@@ -0,0 +1,130 @@
+#ifndef COMPACT_MESH_H
+#define COMPACT_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+enum class element_type : uint8_t
+{
+    line,
+    tri,
+    pris,
+    quad,
+    hex
+};
+
+// Nodes per element and OGS5 element name
+int NodesPerElement(element_type type);
+const char *ElementTypeName(element_type type);
+
+const int max_nodes_per_element = 8;
+
+// Node and element values as handed out by the mesh containers
+struct mesh_node
+{
+    size_t index;
+    double x, y, z;
+};
+
+struct mesh_element
+{
+    size_t index;
+    element_type type;
+    uint16_t material_group;
+    int n_nodes;
+    uint32_t nodes[max_nodes_per_element];
+};
+
+// Iterator over entities that are generated from their index on access
+template <typename Owner, typename Value, Value (Owner::*Generate)(size_t) const>
+class generated_iterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = Value;
+
+    generated_iterator(const Owner *owner, size_t index) : owner_(owner), index_(index) {}
+
+    Value operator*() const { return (owner_->*Generate)(index_); }
+    generated_iterator &operator++() { index_++; return *this; }
+    generated_iterator &operator+=(difference_type n) { index_ += n; return *this; }
+    generated_iterator operator+(difference_type n) const { return generated_iterator(owner_, index_ + n); }
+    difference_type operator-(const generated_iterator &other) const { return static_cast<difference_type>(index_) - static_cast<difference_type>(other.index_); }
+    bool operator==(const generated_iterator &other) const { return index_ == other.index_; }
+    bool operator!=(const generated_iterator &other) const { return index_ != other.index_; }
+
+    size_t index() const { return index_; }
+
+private:
+    const Owner *owner_;
+    size_t index_;
+};
+
+template <typename Iterator>
+class generated_range
+{
+public:
+    generated_range(Iterator first, Iterator last) : first_(first), last_(last) {}
+
+    Iterator begin() const { return first_; }
+    Iterator end() const { return last_; }
+    size_t size() const { return last_ - first_; }
+
+private:
+    Iterator first_, last_;
+};
+
+// Consecutive elements of one type, their nodes start at first_connectivity
+struct element_block
+{
+    element_type type;
+    size_t first_element;
+    size_t n_elements;
+    size_t first_connectivity;
+};
+
+// Unstructured mesh in structure-of-arrays layout:
+// coordinate arrays, one flat 32 bit connectivity array addressed through
+// per-block offsets, one element type per block and 16 bit material groups
+class compact_mesh
+{
+public:
+    std::vector<double> x, y, z;
+    std::vector<uint32_t> connectivity;
+    std::vector<element_block> blocks;
+    std::vector<uint16_t> material_groups;
+
+    void clear();
+    void reserve(size_t n_nodes, size_t n_elements, size_t n_connectivity);
+
+    uint32_t add_node(double node_x, double node_y, double node_z);
+    size_t add_element(element_type type, const uint32_t *nodes, uint16_t material_group);
+
+    // Presizing for concurrent filling: resize the node arrays and append a block
+    // of n_elements zero-initialized elements, returns the block index
+    void resize_nodes(size_t n_nodes);
+    size_t add_block(element_type type, size_t n_elements);
+
+    size_t n_nodes() const { return x.size(); }
+    size_t n_elements() const { return material_groups.size(); }
+    size_t n_connectivity() const { return connectivity.size(); }
+
+    const element_block &block_of(size_t element) const;
+    const uint32_t *element_nodes(size_t element) const;
+
+    mesh_node node_at(size_t index) const;
+    mesh_element element_at(size_t index) const;
+
+    using node_iterator = generated_iterator<compact_mesh, mesh_node, &compact_mesh::node_at>;
+    using element_iterator = generated_iterator<compact_mesh, mesh_element, &compact_mesh::element_at>;
+
+    generated_range<node_iterator> nodes() const { return generated_range<node_iterator>(node_iterator(this, 0), node_iterator(this, n_nodes())); }
+    generated_range<element_iterator> elements() const { return generated_range<element_iterator>(element_iterator(this, 0), element_iterator(this, n_elements())); }
+};
+
+#endif //COMPACT_MESH_H
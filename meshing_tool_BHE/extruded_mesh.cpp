@@ -0,0 +1,216 @@
+#include "pch.h"
+#include "extruded_mesh.h"
+
+#include <algorithm>
+
+#include "parallel.h"
+
+using namespace std;
+
+void extruded_mesh::node_position(size_t node, size_t &level, size_t &plane_node) const
+{
+    if (column_major)
+    {
+        plane_node = node / n_levels();
+        level = node - plane_node * n_levels();
+    }
+    else
+    {
+        level = node / n_nodes_in_plane();
+        plane_node = node - level * n_nodes_in_plane();
+    }
+}
+
+void extruded_mesh::prism_position(size_t prism, size_t &level, size_t &plane_element) const
+{
+    if (column_major)
+    {
+        plane_element = prism / n_element_levels();
+        level = prism - plane_element * n_element_levels();
+    }
+    else
+    {
+        level = prism / n_elems_in_plane();
+        plane_element = prism - level * n_elems_in_plane();
+    }
+}
+
+mesh_node extruded_mesh::node_at(size_t index) const
+{
+    size_t level, plane_node;
+    node_position(index, level, plane_node);
+
+    mesh_node this_node;
+    this_node.index = index;
+    this_node.x = plane.x[plane_node];
+    this_node.y = plane.y[plane_node];
+    this_node.z = z_levels[level];
+
+    return this_node;
+}
+
+mesh_element extruded_mesh::element_at(size_t index) const
+{
+    mesh_element this_element;
+    this_element.index = index;
+
+    size_t n_prism_elements = n_prisms();
+    if (index >= n_prism_elements)
+    {
+        size_t line = index - n_prism_elements;
+
+        this_element.type = element_type::line;
+        this_element.material_group = bhe_mat_groups[line];
+        this_element.n_nodes = 2;
+        this_element.nodes[0] = bhe_connectivity[2 * line];
+        this_element.nodes[1] = bhe_connectivity[2 * line + 1];
+
+        return this_element;
+    }
+
+    size_t level, plane_element;
+    prism_position(index, level, plane_element);
+    const element_block &block = plane.block_of(plane_element);
+    int n_face_nodes = NodesPerElement(block.type);
+    const uint32_t *face = plane.connectivity.data() + block.first_connectivity + (plane_element - block.first_element) * n_face_nodes;
+
+    this_element.type = ExtrudedElementType(block.type);
+    this_element.material_group = level_mat_groups[level];
+    this_element.n_nodes = 2 * n_face_nodes;
+    for (int k = 0; k < n_face_nodes; k++)
+    {
+        this_element.nodes[k] = node_index(level, face[k]);
+        this_element.nodes[k + n_face_nodes] = node_index(level + 1, face[k]);
+    }
+
+    return this_element;
+}
+
+element_type ExtrudedElementType(element_type plane_type)
+{
+    return plane_type == element_type::quad ? element_type::hex : element_type::pris;
+}
+
+// Top face of N nodes followed by the bottom face, for consecutive plane elements of one block
+template <int N>
+static void ExtrudeFaces(const uint32_t *faces, size_t n_faces, uint32_t offset_top, uint32_t offset_bottom, uint32_t *cells)
+{
+    for (size_t k = 0; k < n_faces; k++, faces += N, cells += 2 * N)
+        for (int i = 0; i < N; i++)
+        {
+            cells[i] = faces[i] + offset_top;
+            cells[i + N] = faces[i] + offset_bottom;
+        }
+}
+
+// One column of element levels over one plane element, z varies fastest
+template <int N>
+static void ExtrudeColumn(const uint32_t *face, size_t n_levels, size_t n_elem_levels, uint32_t *cells)
+{
+    for (size_t level = 0; level < n_elem_levels; level++, cells += 2 * N)
+        for (int i = 0; i < N; i++)
+        {
+            cells[i] = static_cast<uint32_t>(face[i] * n_levels + level);
+            cells[i + N] = cells[i] + 1;
+        }
+}
+
+void MaterializeMesh(const extruded_mesh &mesh, compact_mesh &result, const int n_threads)
+{
+    size_t n_nodes_in_plane = mesh.n_nodes_in_plane();
+    size_t n_elems_in_plane = mesh.n_elems_in_plane();
+    size_t n_elem_levels = mesh.level_mat_groups.size();
+    const vector<element_block> &plane_blocks = mesh.plane.blocks;
+    size_t n_plane_blocks = plane_blocks.size();
+
+    // Blocks in element order: per plane block, or per level and plane block
+    result.clear();
+    result.resize_nodes(mesh.n_nodes());
+    if (mesh.column_major)
+    {
+        for (const element_block &block : plane_blocks)
+            result.add_block(ExtrudedElementType(block.type), block.n_elements * n_elem_levels);
+    }
+    else
+    {
+        for (size_t level = 0; level < n_elem_levels; level++)
+            for (const element_block &block : plane_blocks)
+                result.add_block(ExtrudedElementType(block.type), block.n_elements);
+    }
+    if (mesh.n_bhe_elements() > 0)
+        result.add_block(element_type::line, mesh.n_bhe_elements());
+
+    if (mesh.column_major)
+    {
+        // Every column is independent: the nodes of plane node k and the prisms over plane element k are contiguous
+        size_t n_levels = mesh.n_levels();
+        ParallelFor(n_nodes_in_plane, n_threads, [&](size_t first, size_t last) {
+            for (size_t k = first; k < last; k++)
+            {
+                size_t node_offset = k * n_levels;
+                fill(result.x.begin() + node_offset, result.x.begin() + node_offset + n_levels, mesh.plane.x[k]);
+                fill(result.y.begin() + node_offset, result.y.begin() + node_offset + n_levels, mesh.plane.y[k]);
+                copy(mesh.z_levels.begin(), mesh.z_levels.end(), result.z.begin() + node_offset);
+            }
+        });
+
+        for (size_t b = 0; b < n_plane_blocks; b++)
+        {
+            const element_block &block = plane_blocks[b];
+            bool quads = (block.type == element_type::quad);
+            int n_face_nodes = NodesPerElement(block.type);
+            const uint32_t *faces = mesh.plane.connectivity.data() + block.first_connectivity;
+            uint32_t *cells = result.connectivity.data() + result.blocks[b].first_connectivity;
+
+            ParallelFor(block.n_elements, n_threads, [&](size_t first, size_t last) {
+                for (size_t k = first; k < last; k++)
+                {
+                    const uint32_t *face = faces + n_face_nodes * k;
+                    uint32_t *column = cells + 2 * n_face_nodes * k * n_elem_levels;
+                    if (quads)
+                        ExtrudeColumn<4>(face, n_levels, n_elem_levels, column);
+                    else
+                        ExtrudeColumn<3>(face, n_levels, n_elem_levels, column);
+                    copy(mesh.level_mat_groups.begin(), mesh.level_mat_groups.end(), result.material_groups.begin() + (block.first_element + k) * n_elem_levels);
+                }
+            });
+        }
+    }
+    else
+    {
+        // Every level is independent: node level l and element level l are written by one thread
+        ParallelFor(mesh.n_levels(), n_threads, [&](size_t first_level, size_t last_level) {
+            for (size_t level = first_level; level < last_level; level++)
+            {
+                size_t node_offset = level * n_nodes_in_plane;
+                double z = mesh.z_levels[level];
+
+                copy(mesh.plane.x.begin(), mesh.plane.x.end(), result.x.begin() + node_offset);
+                copy(mesh.plane.y.begin(), mesh.plane.y.end(), result.y.begin() + node_offset);
+                fill(result.z.begin() + node_offset, result.z.begin() + node_offset + n_nodes_in_plane, z);
+
+                if (level >= n_elem_levels)
+                    continue;
+
+                uint32_t offset_top = static_cast<uint32_t>(node_offset);
+                uint32_t offset_bottom = static_cast<uint32_t>(node_offset + n_nodes_in_plane);
+                for (size_t b = 0; b < n_plane_blocks; b++)
+                {
+                    const element_block &block = plane_blocks[b];
+                    const uint32_t *faces = mesh.plane.connectivity.data() + block.first_connectivity;
+                    uint32_t *cells = result.connectivity.data() + result.blocks[level * n_plane_blocks + b].first_connectivity;
+                    if (block.type == element_type::quad)
+                        ExtrudeFaces<4>(faces, block.n_elements, offset_top, offset_bottom, cells);
+                    else
+                        ExtrudeFaces<3>(faces, block.n_elements, offset_top, offset_bottom, cells);
+                }
+
+                fill(result.material_groups.begin() + level * n_elems_in_plane, result.material_groups.begin() + (level + 1) * n_elems_in_plane, mesh.level_mat_groups[level]);
+            }
+        });
+    }
+
+    // BHE line elements follow the prisms
+    copy(mesh.bhe_connectivity.begin(), mesh.bhe_connectivity.end(), result.connectivity.end() - mesh.bhe_connectivity.size());
+    copy(mesh.bhe_mat_groups.begin(), mesh.bhe_mat_groups.end(), result.material_groups.begin() + mesh.n_prisms());
+}
@@ -0,0 +1,72 @@
+#ifndef EXTRUDED_MESH_H
+#define EXTRUDED_MESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "compact_mesh.h"
+
+// Structured extrusion of a 2D mesh: plane x z-levels
+// Only the plane, the z-levels and the material group per element level are stored,
+// 3D nodes and prisms are computed on access. Triangles of the plane give 6-node prisms,
+// quadrilaterals 8-node hexahedra; both are called prisms below. Numbering is level-major:
+//   node  = level * n_nodes_in_plane + plane node
+//   prism = level * n_elems_in_plane + plane element
+// or column-major, where z varies fastest and vertical neighbours are adjacent:
+//   node  = plane node * n_levels + level
+//   prism = plane element * n_element_levels + level
+// BHE line elements follow the prisms.
+struct extruded_mesh
+{
+    compact_mesh plane;                         // 2D nodes, triangles and quadrilaterals
+    std::vector<double> z_levels;               // top down, z_levels[0] is the plane
+    std::vector<uint16_t> level_mat_groups;     // one per element level
+    std::vector<uint32_t> bhe_connectivity;     // two nodes per BHE line element
+    std::vector<uint16_t> bhe_mat_groups;       // one per BHE line element
+    uint16_t first_bhe_group = 1;               // material group of BHE 0, BHE i has first_bhe_group + i
+    bool column_major = false;
+
+    size_t n_nodes_in_plane() const { return plane.n_nodes(); }
+    size_t n_elems_in_plane() const { return plane.n_elements(); }
+    size_t n_levels() const { return z_levels.size(); }
+    size_t n_element_levels() const { return level_mat_groups.size(); }
+    size_t n_nodes() const { return n_nodes_in_plane() * n_levels(); }
+    size_t n_prisms() const { return n_elems_in_plane() * n_element_levels(); }
+    size_t n_bhe_elements() const { return bhe_mat_groups.size(); }
+    size_t n_elements() const { return n_prisms() + n_bhe_elements(); }
+    size_t n_connectivity() const { return 2 * plane.n_connectivity() * n_element_levels() + bhe_connectivity.size(); }
+    // Index of the BHE a line element belongs to, out of range for a foreign material group
+    size_t bhe_of_line(size_t line) const { return static_cast<size_t>(bhe_mat_groups[line]) - first_bhe_group; }
+
+    uint32_t node_index(size_t level, size_t plane_node) const
+    {
+        return static_cast<uint32_t>(column_major ? plane_node * n_levels() + level : level * n_nodes_in_plane() + plane_node);
+    }
+    size_t prism_index(size_t level, size_t plane_element) const
+    {
+        return column_major ? plane_element * n_element_levels() + level : level * n_elems_in_plane() + plane_element;
+    }
+    // Level and plane entity of a 3D node or prism
+    void node_position(size_t node, size_t &level, size_t &plane_node) const;
+    void prism_position(size_t prism, size_t &level, size_t &plane_element) const;
+
+    mesh_node node_at(size_t index) const;
+    mesh_element element_at(size_t index) const;
+
+    using node_iterator = generated_iterator<extruded_mesh, mesh_node, &extruded_mesh::node_at>;
+    using element_iterator = generated_iterator<extruded_mesh, mesh_element, &extruded_mesh::element_at>;
+
+    generated_range<node_iterator> nodes() const { return generated_range<node_iterator>(node_iterator(this, 0), node_iterator(this, n_nodes())); }
+    generated_range<element_iterator> elements() const { return generated_range<element_iterator>(element_iterator(this, 0), element_iterator(this, n_elements())); }
+};
+
+// 3D element over a plane element: prism over a triangle, hexahedron over a quadrilateral
+element_type ExtrudedElementType(element_type plane_type);
+
+// Copies the structured mesh into explicit storage, one element block per plane block
+// (level-major: per level and plane block)
+// Outputs are presized and the levels are filled concurrently on n_threads threads
+void MaterializeMesh(const extruded_mesh &mesh, compact_mesh &result, const int n_threads);
+
+#endif //EXTRUDED_MESH_H
@@ -0,0 +1,189 @@
+#include "pch.h"
+#include "instrumentation.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <system_error>
+
+#include "text_output.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <sys/time.h>
+#endif
+
+using namespace std;
+
+double WallSeconds()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#ifdef _WIN32
+
+double ProcessCPUSeconds()
+{
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time, &user_time))
+        return 0;
+
+    // 100 ns ticks
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernel_time.dwLowDateTime;
+    kernel.HighPart = kernel_time.dwHighDateTime;
+    user.LowPart = user_time.dwLowDateTime;
+    user.HighPart = user_time.dwHighDateTime;
+    return (kernel.QuadPart + user.QuadPart) * 1.0e-7;
+}
+
+uint64_t PeakRSSBytes()
+{
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize;
+}
+
+#else
+
+double ProcessCPUSeconds()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0e-6;
+}
+
+uint64_t PeakRSSBytes()
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+#endif
+
+uint64_t FileBytes(const string &filename)
+{
+    error_code error;
+    uintmax_t size = filesystem::file_size(filename, error);
+    return error ? 0 : static_cast<uint64_t>(size);
+}
+
+run_report::run_report()
+{
+    wall_start_ = WallSeconds();
+    cpu_start_ = ProcessCPUSeconds();
+}
+
+size_t run_report::begin_stage(const string &name)
+{
+    stage_record stage;
+    stage.name = name;
+    stages_.push_back(stage);
+    start_times_.emplace_back(WallSeconds(), ProcessCPUSeconds());
+    return stages_.size() - 1;
+}
+
+void run_report::end_stage(size_t stage)
+{
+    stage_record &record = stages_[stage];
+    record.wall_seconds = WallSeconds() - start_times_[stage].first;
+    record.cpu_seconds = ProcessCPUSeconds() - start_times_[stage].second;
+    record.peak_rss_bytes = PeakRSSBytes();
+    record.finished = true;
+
+    if (listener_)
+        listener_(record);
+}
+
+// Quoted JSON string with escaped quotes, backslashes (Windows paths) and control characters
+static string QuotedJSON(const string &text)
+{
+    static const char digits[] = "0123456789abcdef";
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            quoted.append(1, '\\').append(1, c);
+        else if (static_cast<unsigned char>(c) < 0x20)
+            quoted.append("\\u00").append(1, digits[(c >> 4) & 0xf]).append(1, digits[c & 0xf]);
+        else
+            quoted.append(1, c);
+    }
+    return quoted.append("\"");
+}
+
+void run_report::set_property(const string &name, const string &value)
+{
+    properties_.emplace_back(name, QuotedJSON(value));
+}
+
+void run_report::set_property(const string &name, double value)
+{
+    text_buffer buffer;
+    buffer.put(value);
+    properties_.emplace_back(name, string(buffer.data(), buffer.size()));
+}
+
+bool run_report::write_json(const string &filename) const
+{
+    text_buffer json;
+    uint64_t total_read = 0, total_written = 0;
+
+    json.put("{\n");
+    for (size_t i = 0; i < properties_.size(); i++)
+        json.put("  ").put(QuotedJSON(properties_[i].first)).put(": ").put(properties_[i].second).put(",\n");
+
+    json.put("  \"stages\": [\n");
+    for (size_t i = 0; i < stages_.size(); i++)
+    {
+        const stage_record &stage = stages_[i];
+        total_read += stage.bytes_read;
+        total_written += stage.bytes_written;
+
+        json.put("    {\"name\": ").put(QuotedJSON(stage.name));
+        json.put(", \"finished\": ").put(stage.finished ? "true" : "false");
+        json.put(", \"wall_s\": ").put(stage.wall_seconds);
+        json.put(", \"cpu_s\": ").put(stage.cpu_seconds);
+        json.put(", \"peak_rss_bytes\": ").put(stage.peak_rss_bytes);
+        json.put(", \"bytes_read\": ").put(stage.bytes_read);
+        json.put(", \"bytes_written\": ").put(stage.bytes_written);
+        json.put(", \"counts\": {");
+        for (size_t k = 0; k < stage.counts.size(); k++)
+            json.put(k > 0 ? ", " : "").put(QuotedJSON(stage.counts[k].first)).put(": ").put(stage.counts[k].second);
+        json.put("}}").put(i + 1 < stages_.size() ? ",\n" : "\n");
+    }
+    json.put("  ],\n");
+
+    // Nested stages are counted in their parents' times, bytes are only recorded by leaf stages
+    json.put("  \"total\": {\"wall_s\": ").put(WallSeconds() - wall_start_);
+    json.put(", \"cpu_s\": ").put(ProcessCPUSeconds() - cpu_start_);
+    json.put(", \"peak_rss_bytes\": ").put(PeakRSSBytes());
+    json.put(", \"bytes_read\": ").put(total_read);
+    json.put(", \"bytes_written\": ").put(total_written).put("}\n");
+    json.put("}\n");
+
+    ofstream json_file(filename.c_str(), ios::binary);
+    if (!json_file.is_open())
+    {
+        cout << "Error: Couldn't open report file " << filename << "!" << endl;
+        return false;
+    }
+
+    json_file.write(json.data(), json.size());
+    json_file.close();
+    return !json_file.fail();
+}
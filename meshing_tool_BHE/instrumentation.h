@@ -0,0 +1,64 @@
+#ifndef INSTRUMENTATION_H
+#define INSTRUMENTATION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Process-wide wall clock, CPU time (all threads) and peak resident set size
+double WallSeconds();
+double ProcessCPUSeconds();
+uint64_t PeakRSSBytes();
+// Size of a file, 0 if it doesn't exist
+uint64_t FileBytes(const std::string &filename);
+
+// Measurements of one pipeline stage
+struct stage_record
+{
+    std::string name;
+    double wall_seconds = 0;
+    double cpu_seconds = 0;         // process CPU time, includes concurrent runs of a batch
+    uint64_t peak_rss_bytes = 0;    // process peak at the end of the stage
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    std::vector<std::pair<std::string, uint64_t>> counts;
+    bool finished = false;
+};
+
+// Per-run instrumentation, written as JSON report next to the outputs
+// Stages may nest, begin_stage returns the handle for end_stage and the counters
+class run_report
+{
+public:
+    run_report();
+
+    size_t begin_stage(const std::string &name);
+    void end_stage(size_t stage);
+
+    void add_count(size_t stage, const std::string &name, uint64_t value) { stages_[stage].counts.emplace_back(name, value); }
+    void add_bytes_read(size_t stage, uint64_t bytes) { stages_[stage].bytes_read += bytes; }
+    void add_bytes_written(size_t stage, uint64_t bytes) { stages_[stage].bytes_written += bytes; }
+
+    const std::vector<stage_record> &stages() const { return stages_; }
+
+    // Called with each finished stage (progress of server jobs)
+    void set_listener(const std::function<void(const stage_record &record)> &listener) { listener_ = listener; }
+
+    // Properties of the run, strings are written quoted
+    void set_property(const std::string &name, const std::string &value);
+    void set_property(const std::string &name, double value);
+
+    bool write_json(const std::string &filename) const;
+
+private:
+    std::vector<stage_record> stages_;
+    std::vector<std::pair<double, double>> start_times_;    // wall, cpu
+    std::vector<std::pair<std::string, std::string>> properties_;
+    double wall_start_, cpu_start_;
+    std::function<void(const stage_record &record)> listener_;
+};
+
+#endif //INSTRUMENTATION_H
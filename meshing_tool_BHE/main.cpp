@@ -0,0 +1,141 @@
+#include "pch.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "batch.h"
+#include "mesh_server.h"
+#include "pipeline.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    // Check input arguments
+    run_options options;
+    int n_jobs = 0, n_gmsh_processes = 1, max_queued = 16;
+    size_t memory_megabytes = 1024;
+    bool batch_mode = (argc >= 2 && string(argv[1]) == string("-batch"));
+    bool server_mode = (argc >= 2 && string(argv[1]) == string("-server"));
+    int first_option = (batch_mode || server_mode) ? 3 : 2;
+
+    // Client of a running server, the mesh goes next to the input unless named
+    if (argc >= 4 && argc <= 5 && string(argv[1]) == string("-client"))
+    {
+        string input_filename = argv[3];
+        if (input_filename == string("-shutdown"))
+            StopServer(string(argv[2]));
+        else
+        {
+            string output_filename = (argc == 5) ? string(argv[4]) : input_filename.substr(0, input_filename.rfind('.')) + ".bhe.msh";
+            RunClient(string(argv[2]), input_filename, output_filename);
+        }
+        return 0;
+    }
+    bool args_ok = (argc >= first_option);
+    options.n_threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+
+    for (int i = first_option; i < argc && args_ok; i++)
+    {
+        if (string(argv[i]) == string("-2D"))
+            options.gmsh_only = true;
+        else if (string(argv[i]) == string("-threads") && i + 1 < argc)
+            options.n_threads = max(1, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-materialize"))
+            options.materialize = true;
+        else if (string(argv[i]) == string("-check"))
+            options.check_mesh = true;
+        else if (string(argv[i]) == string("-incremental"))
+            options.incremental = true;
+        else if (string(argv[i]) == string("-quads"))
+            options.recombine_quads = true;
+        else if (string(argv[i]) == string("-boundary"))
+            options.write_boundary = true;
+        else if (string(argv[i]) == string("-cache") && i + 1 < argc)
+            options.cache_directory = argv[++i];
+        else if (string(argv[i]) == string("-gmsh") && i + 1 < argc)
+            options.gmsh_path = argv[++i];
+        else if (string(argv[i]) == string("-gmsh_threads") && i + 1 < argc)
+            options.gmsh_threads = max(0, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-gmsh_timeout") && i + 1 < argc)
+            options.gmsh_timeout = atof(argv[++i]);
+        else if (string(argv[i]) == string("-jobs") && i + 1 < argc)
+            n_jobs = max(1, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-gmsh_processes") && i + 1 < argc)
+            n_gmsh_processes = max(1, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-queue") && server_mode && i + 1 < argc)
+            max_queued = max(0, atoi(argv[++i]));
+        else if (string(argv[i]) == string("-memory") && (server_mode || batch_mode) && i + 1 < argc)
+            memory_megabytes = static_cast<size_t>(max(0, atoi(argv[++i])));
+        else if (string(argv[i]) == string("-partitions") && i + 2 < argc)
+        {
+            options.n_plane_parts = max(1, atoi(argv[++i]));
+            options.n_level_parts = max(1, atoi(argv[++i]));
+        }
+        else if (string(argv[i]) == string("-mesher") && i + 1 < argc)
+        {
+            string mesher = argv[++i];
+            options.patch_arrays = (mesher == string("patch"));
+            options.native_mesher = (mesher == string("native") || options.patch_arrays);
+            args_ok = options.native_mesher || mesher == string("gmsh");
+        }
+        else if (string(argv[i]) == string("-renumber") && i + 1 < argc)
+        {
+            string renumber = argv[++i];
+            options.renumber_plane = (renumber == string("plane") || renumber == string("all"));
+            options.column_major = (renumber == string("column") || renumber == string("all"));
+            args_ok = options.renumber_plane || options.column_major;
+        }
+        else if (string(argv[i]) == string("-output") && i + 1 < argc)
+        {
+            string output = argv[++i];
+            options.write_msh = (output == string("msh") || output == string("all"));
+            options.write_vtu = (output == string("vtu") || output == string("all"));
+            args_ok = options.write_msh || options.write_vtu;
+        }
+        else
+            args_ok = false;
+    }
+
+    // The previous plane of an incremental run comes from the cache
+    args_ok = args_ok && !(options.incremental && options.cache_directory.empty());
+    // Quadrilaterals come from gmsh, the built-in meshers create triangles
+    args_ok = args_ok && !(options.recombine_quads && (options.native_mesher || options.incremental));
+
+    if (!args_ok)
+    {
+        cout << "Usage: bhe_setup_tool.exe input-filename (-2D) (-threads n) (-output msh|vtu|all) (-materialize) (-mesher gmsh|native|patch) (-cache directory)" << endl;
+        cout << "       (-gmsh path) (-gmsh_threads n) (-gmsh_timeout seconds)" << endl;
+        cout << "       (-partitions n_plane n_vertical) (-renumber plane|column|all) (-check) (-incremental) (-quads) (-boundary)" << endl;
+        cout << "       bhe_setup_tool.exe -batch batch-filename (-jobs n) (-gmsh_processes n) (-memory MB) (other options as above)" << endl;
+        cout << "       bhe_setup_tool.exe -server socket-path (-jobs n) (-queue n) (-memory MB) (other options as above)" << endl;
+        cout << "       bhe_setup_tool.exe -client socket-path input-filename|-shutdown (output-filename)" << endl;
+        return 0;
+    }
+
+    if (server_mode)
+    {
+        if (n_jobs == 0)
+            n_jobs = max(1, options.n_threads / 4);
+        RunServer(string(argv[2]), options, n_jobs, max_queued, memory_megabytes);
+        return 0;
+    }
+
+    if (batch_mode)
+    {
+        if (n_jobs == 0)
+            n_jobs = options.n_threads;
+        RunBatch(string(argv[2]), options, n_jobs, n_gmsh_processes, memory_megabytes);
+        return 0;
+    }
+
+    run_statistics stats;
+    if (!RunPipeline(string(argv[1]), options, run_context(), stats))
+        return 0;
+
+    cout << "Program terminated normally..." << endl;
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "pch.h"
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::~mapped_file()
+{
+    close();
+}
+
+#ifdef _WIN32
+
+bool mapped_file::open(const std::string &filename)
+{
+    close();
+
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size))
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    file_handle_ = file;
+    size_ = static_cast<size_t>(file_size.QuadPart);
+
+    // Empty files can't be mapped, but are valid (empty) input
+    if (size_ == 0)
+        return true;
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+    {
+        close();
+        return false;
+    }
+    mapping_handle_ = mapping;
+
+    data_ = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (data_ == nullptr)
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void mapped_file::close()
+{
+    if (data_ != nullptr)
+        UnmapViewOfFile(data_);
+    if (mapping_handle_ != nullptr)
+        CloseHandle(static_cast<HANDLE>(mapping_handle_));
+    if (file_handle_ != nullptr)
+        CloseHandle(static_cast<HANDLE>(file_handle_));
+
+    data_ = nullptr;
+    size_ = 0;
+    mapping_handle_ = nullptr;
+    file_handle_ = nullptr;
+}
+
+#else
+
+bool mapped_file::open(const std::string &filename)
+{
+    close();
+
+    fd_ = ::open(filename.c_str(), O_RDONLY);
+    if (fd_ < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0)
+    {
+        close();
+        return false;
+    }
+    size_ = static_cast<size_t>(st.st_size);
+
+    // Empty files can't be mapped, but are valid (empty) input
+    if (size_ == 0)
+        return true;
+
+    void *ptr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+    if (ptr == MAP_FAILED)
+    {
+        close();
+        return false;
+    }
+    madvise(ptr, size_, MADV_SEQUENTIAL);
+    data_ = static_cast<const char *>(ptr);
+
+    return true;
+}
+
+void mapped_file::close()
+{
+    if (data_ != nullptr)
+        munmap(const_cast<char *>(data_), size_);
+    if (fd_ >= 0)
+        ::close(fd_);
+
+    data_ = nullptr;
+    size_ = 0;
+    fd_ = -1;
+}
+
+#endif
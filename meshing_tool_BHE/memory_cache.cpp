@@ -0,0 +1,122 @@
+#include "pch.h"
+#include "memory_cache.h"
+
+#include <utility>
+
+using namespace std;
+
+static size_t PlaneBytes(const compact_mesh &plane)
+{
+    return (plane.x.size() + plane.y.size() + plane.z.size()) * sizeof(double) + plane.connectivity.size() * sizeof(uint32_t) +
+           plane.material_groups.size() * sizeof(uint16_t) + plane.blocks.size() * sizeof(element_block);
+}
+
+static size_t ExtrudedBytes(const extruded_mesh &mesh)
+{
+    return PlaneBytes(mesh.plane) + mesh.z_levels.size() * sizeof(double) + mesh.level_mat_groups.size() * sizeof(uint16_t) +
+           mesh.bhe_connectivity.size() * sizeof(uint32_t) + mesh.bhe_mat_groups.size() * sizeof(uint16_t);
+}
+
+const memory_cache::entry *memory_cache::find(uint64_t key, bool extruded)
+{
+    entry_index &index = index_of(extruded);
+    auto found = index.find(key);
+    if (found == index.end())
+        return nullptr;
+
+    // Move to the front, iterators stay valid
+    entries_.splice(entries_.begin(), entries_, found->second);
+    return &entries_.front();
+}
+
+void memory_cache::insert(entry &&new_entry)
+{
+    entry_index &index = index_of(new_entry.extruded);
+    auto found = index.find(new_entry.key);
+    if (found != index.end())
+    {
+        size_bytes_ -= found->second->bytes;
+        entries_.erase(found->second);
+        index.erase(found);
+    }
+
+    // Entries larger than the whole cache aren't kept
+    if (new_entry.bytes > capacity_bytes_)
+        return;
+
+    size_bytes_ += new_entry.bytes;
+    entries_.push_front(move(new_entry));
+    index[entries_.front().key] = entries_.begin();
+
+    while (size_bytes_ > capacity_bytes_)
+    {
+        entry &oldest = entries_.back();
+        size_bytes_ -= oldest.bytes;
+        index_of(oldest.extruded).erase(oldest.key);
+        entries_.pop_back();
+    }
+}
+
+bool memory_cache::get_plane(uint64_t key, compact_mesh &plane)
+{
+    shared_ptr<const compact_mesh> cached;
+    {
+        lock_guard<mutex> lock(mutex_);
+        const entry *found = find(key, false);
+        if (found == nullptr)
+            return false;
+        cached = found->plane;
+    }
+    plane = *cached;
+    return true;
+}
+
+void memory_cache::put_plane(uint64_t key, const compact_mesh &plane)
+{
+    entry new_entry;
+    new_entry.key = key;
+    new_entry.extruded = false;
+    new_entry.plane = make_shared<const compact_mesh>(plane);
+    new_entry.bytes = PlaneBytes(plane);
+
+    lock_guard<mutex> lock(mutex_);
+    insert(move(new_entry));
+}
+
+bool memory_cache::get_extruded(uint64_t key, extruded_mesh &mesh)
+{
+    shared_ptr<const extruded_mesh> cached;
+    {
+        lock_guard<mutex> lock(mutex_);
+        const entry *found = find(key, true);
+        if (found == nullptr)
+            return false;
+        cached = found->mesh;
+    }
+    mesh = *cached;
+    return true;
+}
+
+void memory_cache::put_extruded(uint64_t key, const extruded_mesh &mesh)
+{
+    entry new_entry;
+    new_entry.key = key;
+    new_entry.extruded = true;
+    new_entry.mesh = make_shared<const extruded_mesh>(mesh);
+    new_entry.bytes = ExtrudedBytes(mesh);
+
+    lock_guard<mutex> lock(mutex_);
+    insert(move(new_entry));
+}
+
+size_t memory_cache::size_bytes()
+{
+    lock_guard<mutex> lock(mutex_);
+    return size_bytes_;
+}
+
+size_t memory_cache::n_entries()
+{
+    lock_guard<mutex> lock(mutex_);
+    return entries_.size();
+}
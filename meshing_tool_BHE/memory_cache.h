@@ -0,0 +1,54 @@
+#ifndef MEMORY_CACHE_H
+#define MEMORY_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+
+// In-memory LRU cache of planes and extruded meshes for runs in one long-lived process,
+// keyed by PlaneKey and ExtrusionKey. The least recently used entries are dropped when the
+// total size exceeds capacity_bytes. Entries are immutable and copied out, access is thread-safe.
+class memory_cache
+{
+public:
+    explicit memory_cache(size_t capacity_bytes) : capacity_bytes_(capacity_bytes) {}
+
+    bool get_plane(uint64_t key, compact_mesh &plane);
+    void put_plane(uint64_t key, const compact_mesh &plane);
+    bool get_extruded(uint64_t key, extruded_mesh &mesh);
+    void put_extruded(uint64_t key, const extruded_mesh &mesh);
+
+    size_t size_bytes();
+    size_t n_entries();
+
+private:
+    struct entry
+    {
+        uint64_t key;
+        bool extruded;
+        std::shared_ptr<const compact_mesh> plane;
+        std::shared_ptr<const extruded_mesh> mesh;
+        size_t bytes;
+    };
+
+    using entry_list = std::list<entry>;
+    using entry_index = std::unordered_map<uint64_t, entry_list::iterator>;
+
+    entry_index &index_of(bool extruded) { return extruded ? extruded_index_ : plane_index_; }
+    const entry *find(uint64_t key, bool extruded);
+    void insert(entry &&new_entry);
+
+    std::mutex mutex_;
+    entry_list entries_;            // most recently used first
+    entry_index plane_index_, extruded_index_;
+    size_t capacity_bytes_;
+    size_t size_bytes_ = 0;
+};
+
+#endif //MEMORY_CACHE_H
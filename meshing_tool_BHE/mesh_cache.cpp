@@ -0,0 +1,537 @@
+#include "pch.h"
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <system_error>
+#include <thread>
+
+#include "mapped_file.h"
+
+using namespace std;
+
+// Bump when the entry layout or the meaning of a key changes
+const uint32_t cache_version = 5;
+const char cache_magic[8] = { 'B', 'H', 'E', 'C', 'A', 'C', 'H', 'E' };
+
+struct cache_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t kind;
+    uint64_t key;
+};
+
+enum cache_kind : uint32_t
+{
+    cache_plane = 1,
+    cache_extruded = 2,
+    cache_layout = 3
+};
+
+content_hash &content_hash::add(const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+        value_ ^= bytes[i];
+        value_ *= 1099511628211ull;
+    }
+    return *this;
+}
+
+static string HexString(uint64_t value)
+{
+    static const char digits[] = "0123456789abcdef";
+    string result(16, '0');
+    for (int i = 0; i < 16; i++)
+        result[i] = digits[(value >> (60 - 4 * i)) & 0xf];
+    return result;
+}
+
+string content_hash::hex() const
+{
+    return HexString(value_);
+}
+
+uint64_t PlaneKey(const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points, const bool native_mesher, const bool patch_arrays,
+                  const bool recombine_quads)
+{
+    content_hash hash;
+    hash.add(cache_version).add(native_mesher).add(patch_arrays).add(recombine_quads);
+    hash.add(geom.width).add(geom.length);
+    hash.add(geom.box_start).add(geom.box_length).add(geom.box_width);
+    hash.add(geom.elem_size_box).add(geom.elem_size_corner);
+    hash.add(geom.field_growth).add(geom.field_max_size);
+
+    hash.add(BHEs.size());
+    for (size_t i = 0; i < BHEs.size(); i++)
+        hash.add(BHEs[i].bhe_x).add(BHEs[i].bhe_y).add(BHEs[i].bhe_radius);
+
+    hash.add(add_points.size());
+    for (size_t i = 0; i < add_points.size(); i++)
+        hash.add(add_points[i].x).add(add_points[i].y).add(add_points[i].delta);
+
+    return hash.value();
+}
+
+uint64_t LayoutKey(const geometry &geom, const vector<additional_point> &add_points)
+{
+    content_hash hash;
+    hash.add(cache_version).add(static_cast<uint32_t>(cache_layout));
+    hash.add(geom.width).add(geom.length);
+    hash.add(geom.box_start).add(geom.box_length).add(geom.box_width);
+    hash.add(geom.elem_size_box).add(geom.elem_size_corner);
+
+    hash.add(add_points.size());
+    for (size_t i = 0; i < add_points.size(); i++)
+        hash.add(add_points[i].x).add(add_points[i].y).add(add_points[i].delta);
+
+    return hash.value();
+}
+
+uint64_t ExtrusionKey(const uint64_t plane_key, const geometry &geom, const vector<layer> &layers, const vector<bhe> &BHEs, const bool renumber_plane, const bool column_major)
+{
+    content_hash hash;
+    hash.add(plane_key).add(geom.depth).add(geom.bhe_tolerance);
+    hash.add(renumber_plane).add(column_major);
+    hash.add(geom.auto_min_thickness).add(geom.auto_growth).add(geom.auto_max_aspect).add(geom.elem_size_box);
+
+    hash.add(layers.size());
+    for (size_t i = 0; i < layers.size(); i++)
+        hash.add(layers[i].mat_group).add(layers[i].n_elems).add(layers[i].elem_thickness);
+
+    hash.add(BHEs.size());
+    for (size_t i = 0; i < BHEs.size(); i++)
+        hash.add(BHEs[i].bhe_top).add(BHEs[i].bhe_bottom);
+
+    return hash.value();
+}
+
+// Arrays are stored as uint64 count followed by the raw values
+template <typename T>
+static void WriteArray(ofstream &out, const vector<T> &values)
+{
+    uint64_t count = values.size();
+    out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char *>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+static bool ReadArray(const char *&pos, const char *end, vector<T> &values)
+{
+    uint64_t count;
+    if (static_cast<size_t>(end - pos) < sizeof(count))
+        return false;
+    memcpy(&count, pos, sizeof(count));
+    pos += sizeof(count);
+
+    if (count > static_cast<size_t>(end - pos) / sizeof(T))
+        return false;
+    values.resize(count);
+    memcpy(values.data(), pos, count * sizeof(T));
+    pos += count * sizeof(T);
+    return true;
+}
+
+// Blocks as element type and element count per block
+static void WritePlane(ofstream &out, const compact_mesh &plane)
+{
+    vector<uint8_t> block_types;
+    vector<uint64_t> block_sizes;
+    for (const element_block &block : plane.blocks)
+    {
+        block_types.push_back(static_cast<uint8_t>(block.type));
+        block_sizes.push_back(block.n_elements);
+    }
+
+    WriteArray(out, plane.x);
+    WriteArray(out, plane.y);
+    WriteArray(out, plane.z);
+    WriteArray(out, block_types);
+    WriteArray(out, block_sizes);
+    WriteArray(out, plane.connectivity);
+    WriteArray(out, plane.material_groups);
+}
+
+static bool ReadPlane(const char *&pos, const char *end, compact_mesh &plane)
+{
+    vector<uint8_t> block_types;
+    vector<uint64_t> block_sizes;
+    vector<uint32_t> connectivity;
+    vector<uint16_t> material_groups;
+
+    plane.clear();
+    if (!ReadArray(pos, end, plane.x) || !ReadArray(pos, end, plane.y) || !ReadArray(pos, end, plane.z) || !ReadArray(pos, end, block_types) ||
+        !ReadArray(pos, end, block_sizes) || !ReadArray(pos, end, connectivity) || !ReadArray(pos, end, material_groups))
+        return false;
+
+    if (plane.y.size() != plane.x.size() || plane.z.size() != plane.x.size() || block_sizes.size() != block_types.size())
+        return false;
+
+    for (size_t b = 0; b < block_types.size(); b++)
+    {
+        element_type type = static_cast<element_type>(block_types[b]);
+        if ((type != element_type::tri && type != element_type::quad) || block_sizes[b] > material_groups.size() - plane.n_elements())
+            return false;
+        plane.add_block(type, block_sizes[b]);
+    }
+    if (plane.n_elements() != material_groups.size() || plane.n_connectivity() != connectivity.size())
+        return false;
+
+    copy(connectivity.begin(), connectivity.end(), plane.connectivity.begin());
+    copy(material_groups.begin(), material_groups.end(), plane.material_groups.begin());
+
+    return all_of(connectivity.begin(), connectivity.end(), [&](uint32_t node) { return node < plane.n_nodes(); });
+}
+
+string mesh_cache::entry_filename(const char *kind, uint64_t key) const
+{
+    return (filesystem::path(directory_) / (string(kind) + "_" + HexString(key) + ".bin")).string();
+}
+
+static bool OpenEntry(const string &filename, mapped_file &file, uint32_t kind, uint64_t key, const char *&pos)
+{
+    cache_header header;
+
+    if (!file.open(filename) || file.size() < sizeof(header))
+        return false;
+
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0 || header.version != cache_version || header.kind != kind || header.key != key)
+        return false;
+
+    pos = file.data() + sizeof(header);
+    return true;
+}
+
+template <typename Write>
+static bool StoreEntry(const string &filename, uint32_t kind, uint64_t key, Write write)
+{
+    error_code error;
+    filesystem::create_directories(filesystem::path(filename).parent_path(), error);
+
+    // Unique temporary name, renamed into place when complete
+    content_hash unique;
+    unique.add(key).add(hash<thread::id>()(this_thread::get_id())).add(chrono::steady_clock::now().time_since_epoch().count());
+    string temp_filename = filename + "." + unique.hex() + ".tmp";
+
+    ofstream out(temp_filename.c_str(), ios::binary);
+    if (!out.is_open())
+        return false;
+
+    cache_header header;
+    memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.kind = kind;
+    header.key = key;
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    write(out);
+    out.close();
+
+    if (out.fail())
+    {
+        filesystem::remove(temp_filename, error);
+        return false;
+    }
+
+    filesystem::rename(temp_filename, filename, error);
+    if (error)
+    {
+        filesystem::remove(temp_filename, error);
+        return false;
+    }
+    return true;
+}
+
+// Entries are read whole, a complete entry adds its size
+static bool CountRead(bool ok, const mapped_file &file, uint64_t *bytes_read)
+{
+    if (ok && bytes_read)
+        *bytes_read += file.size();
+    return ok;
+}
+
+bool mesh_cache::load_plane(uint64_t key, compact_mesh &plane, uint64_t *bytes_read) const
+{
+    mapped_file file;
+    const char *pos;
+
+    if (!OpenEntry(entry_filename("plane", key), file, cache_plane, key, pos))
+        return false;
+
+    return CountRead(ReadPlane(pos, file.end(), plane), file, bytes_read);
+}
+
+bool mesh_cache::store_plane(uint64_t key, const compact_mesh &plane) const
+{
+    return StoreEntry(entry_filename("plane", key), cache_plane, key, [&](ofstream &out) { WritePlane(out, plane); });
+}
+
+bool mesh_cache::load_extruded(uint64_t key, extruded_mesh &mesh, uint64_t *bytes_read) const
+{
+    mapped_file file;
+    const char *pos;
+
+    vector<uint8_t> numbering;
+    vector<uint16_t> first_bhe_group;
+
+    if (!OpenEntry(entry_filename("extruded", key), file, cache_extruded, key, pos))
+        return false;
+
+    if (!ReadPlane(pos, file.end(), mesh.plane) || !ReadArray(pos, file.end(), mesh.z_levels) || !ReadArray(pos, file.end(), mesh.level_mat_groups) ||
+        !ReadArray(pos, file.end(), mesh.bhe_connectivity) || !ReadArray(pos, file.end(), mesh.bhe_mat_groups) || !ReadArray(pos, file.end(), numbering) ||
+        !ReadArray(pos, file.end(), first_bhe_group))
+        return false;
+
+    mesh.column_major = (numbering.size() == 1 && numbering[0] == 1);
+    mesh.first_bhe_group = first_bhe_group.empty() ? 1 : first_bhe_group[0];
+    bool ok = numbering.size() == 1 && first_bhe_group.size() == 1 && mesh.level_mat_groups.size() + 1 == mesh.z_levels.size() && mesh.bhe_connectivity.size() == 2 * mesh.bhe_mat_groups.size() &&
+              all_of(mesh.bhe_connectivity.begin(), mesh.bhe_connectivity.end(), [&](uint32_t node) { return node < mesh.n_nodes(); });
+    return CountRead(ok, file, bytes_read);
+}
+
+bool mesh_cache::store_extruded(uint64_t key, const extruded_mesh &mesh) const
+{
+    return StoreEntry(entry_filename("extruded", key), cache_extruded, key, [&](ofstream &out) {
+        WritePlane(out, mesh.plane);
+        WriteArray(out, mesh.z_levels);
+        WriteArray(out, mesh.level_mat_groups);
+        WriteArray(out, mesh.bhe_connectivity);
+        WriteArray(out, mesh.bhe_mat_groups);
+        WriteArray(out, vector<uint8_t>(1, mesh.column_major ? 1 : 0));
+        WriteArray(out, vector<uint16_t>(1, mesh.first_bhe_group));
+    });
+}
+
+bool mesh_cache::load_layout(uint64_t key, compact_mesh &plane, vector<bhe> &BHEs, uint64_t *bytes_read) const
+{
+    mapped_file file;
+    const char *pos;
+
+    vector<int32_t> numbers;
+    vector<double> x, y, radius;
+
+    if (!OpenEntry(entry_filename("layout", key), file, cache_layout, key, pos))
+        return false;
+
+    if (!ReadPlane(pos, file.end(), plane) || !ReadArray(pos, file.end(), numbers) || !ReadArray(pos, file.end(), x) || !ReadArray(pos, file.end(), y) ||
+        !ReadArray(pos, file.end(), radius) || x.size() != numbers.size() || y.size() != numbers.size() || radius.size() != numbers.size())
+        return false;
+
+    BHEs.resize(numbers.size());
+    for (size_t i = 0; i < numbers.size(); i++)
+    {
+        BHEs[i].bhe_number = numbers[i];
+        BHEs[i].bhe_x = x[i];
+        BHEs[i].bhe_y = y[i];
+        BHEs[i].bhe_radius = radius[i];
+        BHEs[i].bhe_top = BHEs[i].bhe_bottom = 0;
+    }
+    return CountRead(true, file, bytes_read);
+}
+
+bool mesh_cache::store_layout(uint64_t key, const compact_mesh &plane, const vector<bhe> &BHEs) const
+{
+    vector<int32_t> numbers(BHEs.size());
+    vector<double> x(BHEs.size()), y(BHEs.size()), radius(BHEs.size());
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        numbers[i] = BHEs[i].bhe_number;
+        x[i] = BHEs[i].bhe_x;
+        y[i] = BHEs[i].bhe_y;
+        radius[i] = BHEs[i].bhe_radius;
+    }
+
+    return StoreEntry(entry_filename("layout", key), cache_layout, key, [&](ofstream &out) {
+        WritePlane(out, plane);
+        WriteArray(out, numbers);
+        WriteArray(out, x);
+        WriteArray(out, y);
+        WriteArray(out, radius);
+    });
+}
+
+// Content compared and hashed per chunk of this size
+const size_t replace_chunk_size = 1 << 20;
+
+replacing_buffer::replacing_buffer(const string &filename, bool binary)
+    : filename_(filename), temp_filename_(filename + ".tmp"), hash_filename_(filename + ".hash"), mode_(binary ? ios::binary : ios::openmode())
+{
+    error_code error;
+    chunk_.resize(replace_chunk_size);
+    setp(chunk_.data(), chunk_.data() + chunk_.size());
+
+    // Hashes are only valid for the file they were recorded for: same size and time stamp
+    uint64_t file_size = filesystem::file_size(filename_, error);
+    if (!error)
+    {
+        auto file_time = filesystem::last_write_time(filename_, error);
+        ifstream hash_file(hash_filename_.c_str());
+        long long recorded_time;
+        size_t n_hashes;
+        if (!error && hash_file >> old_size_ >> recorded_time >> n_hashes && old_size_ == file_size &&
+            recorded_time == static_cast<long long>(file_time.time_since_epoch().count()))
+        {
+            old_hashes_.resize(n_hashes);
+            for (size_t i = 0; i < n_hashes && hash_file; i++)
+                hash_file >> hex >> old_hashes_[i];
+            compare_hashes_ = !hash_file.fail() && n_hashes == (old_size_ + replace_chunk_size - 1) / replace_chunk_size;
+        }
+        compare_content_ = !compare_hashes_ && file_size <= replace_chunk_size;
+    }
+
+    // Nothing to compare with, written right away
+    if (!compare_hashes_ && !compare_content_)
+        ok_ = start_writing(0);
+}
+
+replacing_buffer::~replacing_buffer()
+{
+    if (temp_.is_open())
+    {
+        error_code error;
+        temp_.close();
+        filesystem::remove(temp_filename_, error);
+    }
+}
+
+bool replacing_buffer::start_writing(size_t n_equal_chunks)
+{
+    temp_.open(temp_filename_.c_str(), mode_ | ios::out | ios::trunc);
+    if (!temp_.is_open())
+        return false;
+
+    // The equal part of the old file
+    ifstream old_file(filename_.c_str(), mode_ | ios::in);
+    vector<char> copy(replace_chunk_size);
+    for (size_t k = 0; k < n_equal_chunks; k++)
+    {
+        if (!old_file.read(copy.data(), copy.size()))
+            return false;
+        temp_.write(copy.data(), copy.size());
+        bytes_written_ += copy.size();
+    }
+
+    compare_hashes_ = compare_content_ = false;
+    return static_cast<bool>(temp_);
+}
+
+bool replacing_buffer::old_content_equals(const char *data, size_t size) const
+{
+    ifstream old_file(filename_.c_str(), mode_ | ios::in);
+    vector<char> content(size + 1);
+    old_file.read(content.data(), content.size());
+    return static_cast<size_t>(old_file.gcount()) == size && memcmp(content.data(), data, size) == 0;
+}
+
+bool replacing_buffer::end_chunk(bool last)
+{
+    size_t n = pptr() - pbase();
+    size_t k = new_hashes_.size();
+    bool has_chunk = (n > 0 || k == 0);
+    if (has_chunk)
+        new_hashes_.push_back(content_hash().add(pbase(), n).value());
+    size_ += n;
+
+    if (compare_hashes_)
+    {
+        // A chunk equal to the recorded one, at the end also the same size
+        bool equal = (!has_chunk || (k < old_hashes_.size() && new_hashes_.back() == old_hashes_[k])) && (!last || size_ == old_size_);
+        if (!equal && !start_writing(k))
+            return false;
+    }
+    else if (compare_content_)
+    {
+        // Small old file, a full chunk differs in size already
+        if (!(last && old_content_equals(pbase(), n)) && !start_writing(0))
+            return false;
+    }
+
+    if (temp_.is_open())
+    {
+        temp_.write(pbase(), n);
+        bytes_written_ += n;
+    }
+    setp(chunk_.data(), chunk_.data() + chunk_.size());
+    return static_cast<bool>(temp_) || !temp_.is_open();
+}
+
+replacing_buffer::int_type replacing_buffer::overflow(int_type c)
+{
+    if (!ok_ || !(ok_ = end_chunk(false)))
+        return traits_type::eof();
+    if (!traits_type::eq_int_type(c, traits_type::eof()))
+        sputc(traits_type::to_char_type(c));
+    return traits_type::not_eof(c);
+}
+
+streamsize replacing_buffer::xsputn(const char *s, streamsize n)
+{
+    streamsize written = 0;
+    while (written < n)
+    {
+        if (pptr() == epptr() && overflow(traits_type::eof()) == traits_type::eof())
+            break;
+        streamsize part = min<streamsize>(n - written, epptr() - pptr());
+        memcpy(pptr(), s + written, part);
+        pbump(static_cast<int>(part));
+        written += part;
+    }
+    return written;
+}
+
+bool replacing_buffer::write_hashes()
+{
+    error_code error;
+    auto file_time = filesystem::last_write_time(filename_, error);
+    if (error)
+        return false;
+
+    ofstream hash_file(hash_filename_.c_str());
+    hash_file << size_ << " " << static_cast<long long>(file_time.time_since_epoch().count()) << " " << new_hashes_.size() << hex;
+    for (uint64_t hash : new_hashes_)
+        hash_file << "\n" << hash;
+    hash_file << "\n";
+    return !hash_file.fail();
+}
+
+bool replacing_buffer::commit(bool &changed)
+{
+    error_code error;
+    changed = false;
+    if (committed_)
+        return false;
+    committed_ = true;
+
+    ok_ = ok_ && end_chunk(true);
+    changed = temp_.is_open();
+    if (!changed)
+        return ok_;
+
+    temp_.close();
+    if (!ok_ || temp_.fail())
+    {
+        filesystem::remove(temp_filename_, error);
+        return false;
+    }
+
+    // Hashes of the old content are stale from here on
+    filesystem::remove(hash_filename_, error);
+    filesystem::rename(temp_filename_, filename_, error);
+    if (error)
+    {
+        filesystem::remove(temp_filename_, error);
+        return false;
+    }
+
+    // Small outputs are compared directly, a missing hash file just means a rewrite next time
+    if (size_ > replace_chunk_size)
+        write_hashes();
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "meshing_tool_BHE.h"
+
+// 64 bit FNV-1a hash over the binary representation of the inputs
+class content_hash
+{
+public:
+    content_hash &add(const void *data, size_t size);
+
+    template <typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value>::type>
+    content_hash &add(T value) { return add(&value, sizeof(T)); }
+
+    uint64_t value() const { return value_; }
+    std::string hex() const;
+
+private:
+    uint64_t value_ = 14695981039346656037ull;
+};
+
+// Key of the 2D plane: domain, box, element sizes, size fields, BHE x/y/radius, additional points and mesher
+uint64_t PlaneKey(const geometry &geom, const std::vector<bhe> &BHEs, const std::vector<additional_point> &add_points, const bool native_mesher,
+                  const bool patch_arrays, const bool recombine_quads);
+// Key of the last plane of a layout for incremental remeshing: as PlaneKey without the BHEs
+uint64_t LayoutKey(const geometry &geom, const std::vector<additional_point> &add_points);
+// Key of the extruded mesh: plane key, depth, layers, BHE depths, tolerance and numbering
+uint64_t ExtrusionKey(const uint64_t plane_key, const geometry &geom, const std::vector<layer> &layers, const std::vector<bhe> &BHEs,
+                      const bool renumber_plane, const bool column_major);
+
+// On-disk cache of imported planes and extruded meshes, one binary file per key
+// Files are written to a temporary name and renamed, so concurrent runs never see partial entries
+class mesh_cache
+{
+public:
+    explicit mesh_cache(const std::string &directory) : directory_(directory) {}
+
+    // Loads add the size of the entry read to bytes_read
+    bool load_plane(uint64_t key, compact_mesh &plane, uint64_t *bytes_read = nullptr) const;
+    bool store_plane(uint64_t key, const compact_mesh &plane) const;
+    bool load_extruded(uint64_t key, extruded_mesh &mesh, uint64_t *bytes_read = nullptr) const;
+    bool store_extruded(uint64_t key, const extruded_mesh &mesh) const;
+    // Last plane of a layout with the BHE numbers, positions and radii it was meshed for
+    bool load_layout(uint64_t key, compact_mesh &plane, std::vector<bhe> &BHEs, uint64_t *bytes_read = nullptr) const;
+    bool store_layout(uint64_t key, const compact_mesh &plane, const std::vector<bhe> &BHEs) const;
+
+private:
+    std::string entry_filename(const char *kind, uint64_t key) const;
+
+    std::string directory_;
+};
+
+// Stream buffer of replacing_ofstream, compares and writes the content chunk by chunk
+class replacing_buffer : public std::streambuf
+{
+public:
+    replacing_buffer(const std::string &filename, bool binary);
+    ~replacing_buffer();
+
+    bool is_open() const { return ok_; }
+    bool commit(bool &changed);
+    uint64_t bytes_written() const { return bytes_written_; }
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+
+private:
+    bool end_chunk(bool last);
+    bool start_writing(size_t n_equal_chunks);
+    bool old_content_equals(const char *data, size_t size) const;
+    bool write_hashes();
+
+    std::string filename_, temp_filename_, hash_filename_;
+    std::ios::openmode mode_;
+    std::vector<char> chunk_;
+    std::vector<uint64_t> old_hashes_, new_hashes_;
+    uint64_t old_size_ = 0, size_ = 0, bytes_written_ = 0;
+    bool compare_hashes_ = false, compare_content_ = false;
+    std::ofstream temp_;
+    bool ok_ = true, committed_ = false;
+};
+
+// Output file replaced only if its content changes, so unchanged outputs keep their time stamp.
+// Content goes to <filename>.tmp, which commit() renames over filename. Outputs larger than one chunk
+// record a hash per chunk in <filename>.hash: while the new chunks match the hashes nothing is written,
+// at the first difference the equal part is copied from the old file. Smaller outputs are compared
+// with the old file directly. Without valid hashes (missing, or filename changed since) it is rewritten.
+class replacing_ofstream : public std::ostream
+{
+public:
+    explicit replacing_ofstream(const std::string &filename, bool binary = true) : std::ostream(nullptr), buffer_(filename, binary) { rdbuf(&buffer_); }
+
+    bool is_open() const { return buffer_.is_open(); }
+    // Completes the file, false on errors; changed tells whether filename was replaced
+    bool commit(bool &changed) { return buffer_.commit(changed) && !fail(); }
+    // Bytes that went to disk, 0 if nothing changed
+    uint64_t bytes_written() const { return buffer_.bytes_written(); }
+
+private:
+    replacing_buffer buffer_;
+};
+
+#endif //MESH_CACHE_H
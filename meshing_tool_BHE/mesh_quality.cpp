@@ -0,0 +1,263 @@
+#include "pch.h"
+#include "mesh_quality.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <mutex>
+
+#include "parallel.h"
+#include "spatial_hash.h"
+
+using namespace std;
+
+// Worst elements listed
+static const size_t n_worst = 10;
+
+// Partial results of a range of levels
+struct level_results
+{
+    size_t n_inverted = 0;
+    double min_volume = numeric_limits<double>::max(), max_volume = -numeric_limits<double>::max();
+    double max_aspect2 = 0;
+    size_t histogram[n_aspect_bins] = {};
+    vector<pair<double, size_t>> worst;     // squared aspect ratio, min-heap on the first entry
+};
+
+static void AddWorst(vector<pair<double, size_t>> &worst, double aspect2, size_t element)
+{
+    auto greater_first = [](const pair<double, size_t> &a, const pair<double, size_t> &b) { return a.first > b.first; };
+    if (worst.size() < n_worst)
+    {
+        worst.emplace_back(aspect2, element);
+        push_heap(worst.begin(), worst.end(), greater_first);
+    }
+    else if (aspect2 > worst.front().first)
+    {
+        pop_heap(worst.begin(), worst.end(), greater_first);
+        worst.back() = make_pair(aspect2, element);
+        push_heap(worst.begin(), worst.end(), greater_first);
+    }
+}
+
+static int AspectBin(double aspect2)
+{
+    // log2 of the aspect ratio from the exponent of its square
+    if (!(aspect2 < numeric_limits<double>::infinity()))
+        return n_aspect_bins - 1;
+    return min(n_aspect_bins - 1, max(0, ilogb(aspect2) / 2));
+}
+
+bool CheckMesh(const extruded_mesh &mesh, const vector<bhe> &BHEs, const double tolerance, const int n_threads, mesh_quality &quality)
+{
+    size_t n_plane_nodes = mesh.n_nodes_in_plane();
+    size_t n_plane_elems = mesh.n_elems_in_plane();
+    size_t n_levels = mesh.n_levels();
+    size_t n_element_levels = mesh.n_element_levels();
+    const compact_mesh &plane = mesh.plane;
+
+    quality = mesh_quality();
+
+    // Plane connectivity and per-element values: doubled signed area, shortest and longest squared edge
+    vector<double> area2(n_plane_elems), min_edge2(n_plane_elems), max_edge2(n_plane_elems);
+    vector<char> referenced(n_plane_nodes, 0);
+    for (size_t e = 0; e < n_plane_elems; e++)
+    {
+        mesh_element face = plane.element_at(e);
+        const uint32_t *nodes = face.nodes;
+        int n = face.n_nodes;
+        bool broken = false;
+        for (int k = 0; k < n; k++)
+            broken = broken || nodes[k] >= n_plane_nodes || find(nodes + k + 1, nodes + n, nodes[k]) != nodes + n;
+        if (broken)
+        {
+            quality.n_invalid_elements += n_element_levels;
+            area2[e] = 0;
+            min_edge2[e] = max_edge2[e] = 1;
+            continue;
+        }
+
+        // Corners relative to the first node, triangles as before
+        double x0 = plane.x[nodes[0]], y0 = plane.y[nodes[0]];
+        double dx[4] = { 0 }, dy[4] = { 0 };
+        for (int k = 0; k < n; k++)
+        {
+            referenced[nodes[k]] = 1;
+            dx[k] = plane.x[nodes[k]] - x0;
+            dy[k] = plane.y[nodes[k]] - y0;
+        }
+
+        area2[e] = 0;
+        min_edge2[e] = numeric_limits<double>::max();
+        max_edge2[e] = 0;
+        bool convex = true;
+        for (int k = 0; k < n; k++)
+        {
+            int next = (k + 1) % n, after = (k + 2) % n;
+            double ex = dx[next] - dx[k], ey = dy[next] - dy[k];
+            double length2 = ex * ex + ey * ey;
+            area2[e] += dx[k] * dy[next] - dy[k] * dx[next];
+            min_edge2[e] = min(min_edge2[e], length2);
+            max_edge2[e] = max(max_edge2[e], length2);
+            // Turn at the next corner, hexahedra over non-convex quadrilaterals have inverted corners
+            double turn = ex * (dy[after] - dy[next]) - ey * (dx[after] - dx[next]);
+            convex = convex && turn * (dx[1] * dy[n - 1] - dy[1] * dx[n - 1]) > 0;
+        }
+
+        if (fabs(area2[e]) <= 1e-12 * max_edge2[e] || (n == 4 && !convex))
+            quality.n_degenerate_triangles++;
+    }
+
+    quality.n_unreferenced_nodes = n_levels * count(referenced.begin(), referenced.end(), 0);
+
+    // Coincident plane nodes repeat on every level
+    spatial_hash plane_index(max(tolerance, 1e-12));
+    plane_index.reserve(n_plane_nodes);
+    for (size_t n = 0; n < n_plane_nodes; n++)
+        plane_index.add(plane.x[n], plane.y[n]);
+    plane_index.build();
+    vector<int> close;
+    for (size_t n = 0; n < n_plane_nodes; n++)
+    {
+        close.clear();
+        plane_index.within(plane.x[n], plane.y[n], tolerance, close);
+        if (any_of(close.begin(), close.end(), [&](int other) { return other < static_cast<int>(n); }))
+            quality.n_duplicate_nodes += n_levels;
+    }
+
+    for (size_t level = 0; level < n_element_levels; level++)
+        if (!(mesh.z_levels[level] - mesh.z_levels[level + 1] > tolerance))
+            quality.n_zero_thickness_levels++;
+
+    // Prisms and hexahedra level by level: volume = area * thickness, with the top face first and z decreasing
+    // the Jacobian is -area2 * thickness, positive for the clockwise elements of the plane
+    mutex merge_mutex;
+    level_results total;
+    ParallelFor(n_element_levels, n_threads, [&](size_t first_level, size_t last_level) {
+        level_results results;
+        vector<double> volume(n_plane_elems), aspect2(n_plane_elems);
+
+        for (size_t level = first_level; level < last_level; level++)
+        {
+            double thickness = mesh.z_levels[level] - mesh.z_levels[level + 1];
+            double thickness2 = thickness * thickness;
+
+            // Branch-free batch over the contiguous plane element arrays
+            const double *a = area2.data(), *lo = min_edge2.data(), *hi = max_edge2.data();
+            double *v = volume.data(), *r = aspect2.data();
+            for (size_t e = 0; e < n_plane_elems; e++)
+            {
+                v[e] = -0.5 * a[e] * thickness;
+                r[e] = max(hi[e], thickness2) / min(lo[e], thickness2);
+            }
+
+            for (size_t e = 0; e < n_plane_elems; e++)
+            {
+                double this_aspect2 = (v[e] > 0) ? r[e] : numeric_limits<double>::infinity();
+                results.n_inverted += (v[e] > 0) ? 0 : 1;
+                results.min_volume = min(results.min_volume, v[e]);
+                results.max_volume = max(results.max_volume, v[e]);
+                results.max_aspect2 = max(results.max_aspect2, this_aspect2);
+                results.histogram[AspectBin(this_aspect2)]++;
+                if (results.worst.size() < n_worst || this_aspect2 > results.worst.front().first)
+                    AddWorst(results.worst, this_aspect2, mesh.prism_index(level, e));
+            }
+        }
+
+        lock_guard<mutex> lock(merge_mutex);
+        total.n_inverted += results.n_inverted;
+        total.min_volume = min(total.min_volume, results.min_volume);
+        total.max_volume = max(total.max_volume, results.max_volume);
+        total.max_aspect2 = max(total.max_aspect2, results.max_aspect2);
+        for (int bin = 0; bin < n_aspect_bins; bin++)
+            total.histogram[bin] += results.histogram[bin];
+        for (const auto &entry : results.worst)
+            AddWorst(total.worst, entry.first, entry.second);
+    });
+
+    quality.n_inverted_prisms = total.n_inverted;
+    quality.min_volume = (mesh.n_prisms() > 0) ? total.min_volume : 0;
+    quality.max_volume = (mesh.n_prisms() > 0) ? total.max_volume : 0;
+    quality.max_aspect_ratio = sqrt(total.max_aspect2);
+    copy(total.histogram, total.histogram + n_aspect_bins, quality.aspect_histogram);
+    sort(total.worst.begin(), total.worst.end(), greater<pair<double, size_t>>());
+    for (const auto &entry : total.worst)
+        quality.worst.emplace_back(sqrt(entry.first), entry.second);
+
+    // BHE lines: vertical between adjacent levels of one column
+    vector<double> covered_top(BHEs.size(), -numeric_limits<double>::max()), covered_bottom(BHEs.size(), numeric_limits<double>::max());
+    for (size_t line = 0; line < mesh.n_bhe_elements(); line++)
+    {
+        uint32_t top = mesh.bhe_connectivity[2 * line], bottom = mesh.bhe_connectivity[2 * line + 1];
+        size_t top_level, top_column, bottom_level, bottom_column;
+        if (top >= mesh.n_nodes() || bottom >= mesh.n_nodes())
+        {
+            quality.n_invalid_elements++;
+            continue;
+        }
+        mesh.node_position(top, top_level, top_column);
+        mesh.node_position(bottom, bottom_level, bottom_column);
+        if (top_column != bottom_column || bottom_level != top_level + 1 || !referenced[top_column])
+        {
+            quality.n_invalid_elements++;
+            continue;
+        }
+
+        size_t i = mesh.bhe_of_line(line);
+        if (i < BHEs.size())
+        {
+            covered_top[i] = max(covered_top[i], mesh.z_levels[top_level]);
+            covered_bottom[i] = min(covered_bottom[i], mesh.z_levels[bottom_level]);
+        }
+    }
+    for (size_t i = 0; i < BHEs.size(); i++)
+        if (fabs(covered_top[i] - BHEs[i].bhe_top) > tolerance || fabs(covered_bottom[i] - BHEs[i].bhe_bottom) > tolerance)
+        {
+            quality.n_BHEs_not_covered++;
+            if (covered_top[i] < covered_bottom[i])
+                cout << "Warning: BHE #" << BHEs[i].bhe_number << " has no line elements!" << endl;
+            else
+                cout << "Warning: BHE #" << BHEs[i].bhe_number << " is meshed from " << covered_top[i] << " to " << covered_bottom[i] << " only!" << endl;
+        }
+
+    // Histogram and worst elements
+    cout << "Mesh check: " << mesh.n_prisms() << " prisms, volume " << quality.min_volume << " to " << quality.max_volume
+         << ", max aspect ratio " << quality.max_aspect_ratio << endl;
+    cout << "Aspect ratio histogram:" << endl;
+    for (int bin = 0; bin < n_aspect_bins; bin++)
+    {
+        cout << "  [" << (1 << bin) << ", ";
+        if (bin + 1 < n_aspect_bins)
+            cout << (1 << (bin + 1)) << ")";
+        else
+            cout << "inf]";
+        cout << ": " << quality.aspect_histogram[bin] << endl;
+    }
+    cout << "Worst elements:" << endl;
+    for (const auto &entry : quality.worst)
+    {
+        size_t level, plane_element;
+        mesh.prism_position(entry.second, level, plane_element);
+        cout << "  element " << entry.second << " (level " << level << ", plane element " << plane_element << "): aspect ratio " << entry.first << endl;
+    }
+
+    if (quality.n_duplicate_nodes > 0)
+        cout << "Warning: " << quality.n_duplicate_nodes << " duplicate nodes!" << endl;
+    if (quality.n_unreferenced_nodes > 0)
+        cout << "Warning: " << quality.n_unreferenced_nodes << " unreferenced nodes!" << endl;
+    if (quality.n_zero_thickness_levels > 0)
+        cout << "Warning: " << quality.n_zero_thickness_levels << " element levels without thickness!" << endl;
+
+    if (!quality.valid())
+    {
+        cout << "Error: Invalid mesh with " << quality.n_degenerate_triangles << " degenerate triangles, " << quality.n_inverted_prisms
+             << " inverted prisms and " << quality.n_invalid_elements << " broken elements!" << endl;
+        return false;
+    }
+
+    cout << "Mesh check successful..." << endl;
+    return true;
+}
@@ -0,0 +1,37 @@
+#ifndef MESH_QUALITY_H
+#define MESH_QUALITY_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "extruded_mesh.h"
+#include "meshing_tool_BHE.h"
+
+// Aspect ratio histogram bins [2^k, 2^(k+1)), the last bin is open
+const int n_aspect_bins = 10;
+
+// Results of CheckMesh, node and element counts refer to the 3D mesh
+struct mesh_quality
+{
+    size_t n_degenerate_triangles = 0;      // in the plane, also non-convex quadrilaterals
+    size_t n_inverted_prisms = 0;           // non-positive volume / Jacobian
+    size_t n_zero_thickness_levels = 0;
+    size_t n_duplicate_nodes = 0, n_unreferenced_nodes = 0;
+    size_t n_invalid_elements = 0;          // node index out of range, repeated node, BHE line not vertical
+    size_t n_BHEs_not_covered = 0;          // BHE line elements don't span top to bottom
+    double min_volume = 0, max_volume = 0, max_aspect_ratio = 0;
+    size_t aspect_histogram[n_aspect_bins] = {};
+    std::vector<std::pair<double, size_t>> worst;   // aspect ratio and prism, worst first
+
+    bool valid() const { return n_degenerate_triangles == 0 && n_inverted_prisms == 0 && n_invalid_elements == 0; }
+};
+
+// Checks the extruded mesh after ComputeBHEelements and prints histogram and worst elements
+// Prisms and hexahedra are right prisms over the plane elements, so volume = area * thickness and the
+// Jacobian sign is constant per element. Per-plane-element values are computed once, they are evaluated
+// level by level in branch-free loops over contiguous arrays on n_threads threads.
+// Returns false if the mesh is invalid (degenerate, inverted or broken elements).
+bool CheckMesh(const extruded_mesh &mesh, const std::vector<bhe> &BHEs, const double tolerance, const int n_threads, mesh_quality &quality);
+
+#endif //MESH_QUALITY_H
@@ -0,0 +1,571 @@
+#include "pch.h"
+#include "mesh_server.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+
+using namespace std;
+
+bool RunServer(const string &socket_path, const run_options &options, const int n_jobs, const int max_queued, const size_t memory_megabytes)
+{
+    cout << "Error: Server mode needs Unix domain sockets, not available on this platform!" << endl;
+    return false;
+}
+
+bool RunClient(const string &socket_path, const string &input_filename, const string &output_filename)
+{
+    cout << "Error: Client mode needs Unix domain sockets, not available on this platform!" << endl;
+    return false;
+}
+
+bool StopServer(const string &socket_path)
+{
+    cout << "Error: Client mode needs Unix domain sockets, not available on this platform!" << endl;
+    return false;
+}
+
+#else
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "msh_writer.h"
+
+using namespace std;
+
+// Seconds a client may take to send its request
+const int request_timeout = 60;
+
+// Minimal JSON reader for requests: strings, numbers, arrays and the outer object
+struct json_reader
+{
+    const string &text;
+    size_t pos = 0;
+
+    void skip_blanks()
+    {
+        while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos])))
+            pos++;
+    }
+
+    bool peek(char c)
+    {
+        skip_blanks();
+        return pos < text.size() && text[pos] == c;
+    }
+
+    bool consume(char c)
+    {
+        if (!peek(c))
+            return false;
+        pos++;
+        return true;
+    }
+
+    bool string_value(string &value)
+    {
+        if (!consume('"'))
+            return false;
+        value.clear();
+        while (pos < text.size() && text[pos] != '"')
+        {
+            if (text[pos] == '\\')
+                pos++;
+            if (pos < text.size())
+                value.push_back(text[pos++]);
+        }
+        return pos++ < text.size();
+    }
+
+    // Number, literal or string without blanks, as one input token
+    bool scalar(string &value)
+    {
+        if (peek('"'))
+            return string_value(value) && !value.empty() && value.find_first_of(" \t\r\n") == string::npos;
+
+        size_t start = pos;
+        while (pos < text.size() && !isspace(static_cast<unsigned char>(text[pos])) && text[pos] != ',' && text[pos] != ']' && text[pos] != '}')
+            pos++;
+        value = text.substr(start, pos - start);
+        return !value.empty();
+    }
+
+    // Array of scalars, appended to line as blank separated tokens
+    bool tokens(string &line)
+    {
+        if (!consume('['))
+            return false;
+        if (consume(']'))
+            return true;
+        do
+        {
+            string value;
+            if (!scalar(value))
+                return false;
+            line += ' ' + value;
+        } while (consume(','));
+        return consume(']');
+    }
+};
+
+// {"KEYWORD": value, ...} to input lines: a scalar or an array of scalars gives one line,
+// an array of arrays one line per inner array, e.g. "LAYER": [[1, 10, 5], [2, 4, 10]]
+static bool JsonToInput(const string &json, string &input)
+{
+    json_reader reader{ json };
+    if (!reader.consume('{'))
+        return false;
+    if (reader.consume('}'))
+        return true;
+
+    do
+    {
+        string keyword, line;
+        if (!reader.string_value(keyword) || !reader.consume(':'))
+            return false;
+
+        if (reader.peek('['))
+        {
+            size_t start = reader.pos;
+            reader.consume('[');
+            if (reader.peek('['))
+            {
+                do
+                {
+                    line = keyword;
+                    if (!reader.tokens(line))
+                        return false;
+                    input += line + '\n';
+                } while (reader.consume(','));
+                if (!reader.consume(']'))
+                    return false;
+                continue;
+            }
+            reader.pos = start;
+            line = keyword;
+            if (!reader.tokens(line))
+                return false;
+        }
+        else
+        {
+            string value;
+            if (!reader.scalar(value))
+                return false;
+            line = keyword + ' ' + value;
+        }
+        input += line + '\n';
+    } while (reader.consume(','));
+
+    return reader.consume('}');
+}
+
+// Buffered reads and complete writes on a connected socket, closed on destruction
+class socket_connection
+{
+public:
+    explicit socket_connection(int fd) : fd_(fd) {}
+    ~socket_connection() { close(fd_); }
+    socket_connection(const socket_connection &) = delete;
+    socket_connection &operator=(const socket_connection &) = delete;
+
+    // Line without the line end, false at the end of the stream
+    bool read_line(string &line)
+    {
+        size_t end;
+        while ((end = buffer_.find('\n', pos_)) == string::npos)
+        {
+            if (!fill())
+            {
+                if (pos_ == buffer_.size())
+                    return false;
+                end = buffer_.size();
+                break;
+            }
+        }
+        line.assign(buffer_, pos_, end - pos_);
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        pos_ = min(end + 1, buffer_.size());
+        return true;
+    }
+
+    bool read_bytes(size_t n_bytes, ostream &output)
+    {
+        while (n_bytes > 0)
+        {
+            if (pos_ == buffer_.size() && !fill())
+                return false;
+            size_t n = min(n_bytes, buffer_.size() - pos_);
+            output.write(buffer_.data() + pos_, n);
+            pos_ += n;
+            n_bytes -= n;
+        }
+        return static_cast<bool>(output);
+    }
+
+    bool write(const char *data, size_t n_bytes)
+    {
+        while (n_bytes > 0)
+        {
+            ssize_t n = send(fd_, data, n_bytes, 0);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            n_bytes -= n;
+        }
+        return true;
+    }
+
+    bool write(const string &text) { return write(text.data(), text.size()); }
+
+    bool write_file(const string &filename)
+    {
+        ifstream file(filename.c_str(), ios::binary);
+        char chunk[1 << 16];
+        while (file.read(chunk, sizeof(chunk)) || file.gcount() > 0)
+        {
+            if (!write(chunk, file.gcount()))
+                return false;
+        }
+        return true;
+    }
+
+private:
+    bool fill()
+    {
+        // Consumed data is dropped before reading more
+        buffer_.erase(0, pos_);
+        pos_ = 0;
+
+        char chunk[1 << 16];
+        ssize_t n;
+        do
+            n = recv(fd_, chunk, sizeof(chunk), 0);
+        while (n < 0 && errno == EINTR);
+        if (n <= 0)
+            return false;
+        buffer_.append(chunk, n);
+        return true;
+    }
+
+    int fd_;
+    string buffer_;
+    size_t pos_ = 0;
+};
+
+struct server_state
+{
+    server_state(const run_options &options, int n_jobs, int max_queued, size_t memory_bytes)
+        : options(options), job_slots(n_jobs), memory(memory_bytes), max_pending(n_jobs + max_queued)
+    {
+        context.memory = &memory;
+    }
+
+    run_options options;
+    run_context context;
+    process_limit job_slots;
+    memory_cache memory;
+    const int max_pending;              // running and waiting jobs, more are answered BUSY
+    atomic<int> n_pending{ 0 };
+    atomic<int> next_job{ 1 };
+    atomic<bool> stop{ false };
+
+    mutex connections_mutex;
+    condition_variable connections_done;
+    int n_connections = 0;
+};
+
+static string Trimmed(const string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == string::npos)
+        return string();
+    return text.substr(first, text.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// Meshes one job into <project_name>.bhe.msh, progress is sent while the stages run
+// Relative BHE_FILEs are resolved like for an input file job_name in the working directory
+static bool RunJob(server_state &state, const string &job_name, const string &project_name, const string &input_text, socket_connection &connection,
+                   run_statistics &stats)
+{
+    run_report report;
+    report.set_listener([&](const stage_record &record) {
+        ostringstream progress;
+        progress << "PROGRESS " << record.name << " " << record.wall_seconds << "\n";
+        connection.write(progress.str());
+    });
+
+    // PROJECT of the request is ignored, all files of the job are named after its id
+    model_description model;
+    string ignored_name;
+    istringstream input(input_text);
+    if (!ReadInputStream(input, job_name, ignored_name, model.geom, model.layers, model.BHEs, model.add_points))
+        return false;
+
+    extruded_mesh mesh;
+    if (!BuildMesh(project_name, model, state.options, state.context, mesh, stats, report))
+        return false;
+
+    size_t id = report.begin_stage("WriteMesh");
+    if (!WriteMesh(project_name, mesh, state.options.n_threads))
+        return false;
+    report.end_stage(id);
+    return true;
+}
+
+static void HandleConnection(server_state &state, int fd)
+{
+    socket_connection connection(fd);
+
+    string request, line;
+    while (connection.read_line(line) && line != string("END"))
+        request += line + '\n';
+    request = Trimmed(request);
+
+    if (request == string("SHUTDOWN"))
+    {
+        state.stop = true;
+        connection.write("OK\n");
+        return;
+    }
+
+    string input_text;
+    if (!request.empty() && request[0] == '{')
+    {
+        if (!JsonToInput(request, input_text))
+        {
+            connection.write("RESULT ERROR Invalid JSON request\n");
+            return;
+        }
+    }
+    else
+        input_text = request;
+
+    // Backpressure: a bounded number of jobs runs or waits for a slot
+    if (++state.n_pending > state.max_pending)
+    {
+        state.n_pending--;
+        connection.write("BUSY\n");
+        return;
+    }
+
+    // All files of a job go to its own directory, named by process and job so servers sharing a temporary directory don't collide
+    int job = state.next_job++;
+    string job_name = "job" + to_string(job);
+    filesystem::path job_directory = filesystem::temp_directory_path() / ("bhe_server_" + to_string(getpid()) + "_" + job_name);
+    string project_name = (job_directory / job_name).string();
+    connection.write("ACCEPTED " + to_string(job) + "\n");
+
+    error_code error;
+    filesystem::remove_all(job_directory, error);
+    bool directory_ok = filesystem::create_directory(job_directory, error);
+    if (!directory_ok)
+        cout << "Error: Couldn't create job directory " << job_directory.string() << "!" << endl;
+
+    state.job_slots.acquire();
+    connection.write("STARTED\n");
+    run_statistics stats;
+    bool ok = directory_ok && RunJob(state, job_name, project_name, input_text, connection, stats);
+    state.job_slots.release();
+    state.n_pending--;
+
+    if (ok)
+    {
+        // Streamed after the slot is freed, a slow client doesn't hold up other jobs
+        string mesh_filename = project_name + ".bhe.msh";
+        ostringstream result;
+        result << "RESULT OK " << stats.n_nodes << " " << stats.n_elements << " " << FileBytes(mesh_filename) << "\n";
+        if (connection.write(result.str()))
+            connection.write_file(mesh_filename);
+    }
+    else
+        connection.write("RESULT ERROR Meshing failed, see server output\n");
+
+    filesystem::remove_all(job_directory, error);
+}
+
+static bool SocketAddress(const string &socket_path, sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path))
+    {
+        cout << "Error: Invalid socket path " << socket_path << "!" << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socket_path.c_str());
+    return true;
+}
+
+bool RunServer(const string &socket_path, const run_options &options, const int n_jobs, const int max_queued, const size_t memory_megabytes)
+{
+    sockaddr_un address;
+    if (!SocketAddress(socket_path, address))
+        return false;
+
+    // Writes to clients that went away fail instead of ending the process
+    signal(SIGPIPE, SIG_IGN);
+
+    // A socket left over from a previous server is replaced
+    struct stat existing;
+    if (stat(socket_path.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode))
+        unlink(socket_path.c_str());
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(listener, 64) != 0)
+    {
+        cout << "Error: Couldn't listen on socket " << socket_path << ": " << strerror(errno) << "!" << endl;
+        if (listener >= 0)
+            close(listener);
+        return false;
+    }
+
+    server_state state(options, n_jobs, max_queued, memory_megabytes << 20);
+    state.options.write_gli = false;
+    state.options.gmsh_only = false;
+    cout << "Server listening on " << socket_path << " with " << n_jobs << " jobs..." << endl;
+
+    while (!state.stop)
+    {
+        // Polled with a timeout to notice a shutdown request
+        pollfd ready = { listener, POLLIN, 0 };
+        if (poll(&ready, 1, 200) <= 0)
+            continue;
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0)
+            continue;
+
+        timeval timeout = { request_timeout, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+        {
+            lock_guard<mutex> lock(state.connections_mutex);
+            state.n_connections++;
+        }
+        thread([&state, fd]() {
+            HandleConnection(state, fd);
+            lock_guard<mutex> lock(state.connections_mutex);
+            state.n_connections--;
+            state.connections_done.notify_all();
+        }).detach();
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+
+    // Running jobs are finished
+    unique_lock<mutex> lock(state.connections_mutex);
+    state.connections_done.wait(lock, [&state]() { return state.n_connections == 0; });
+    cout << "Server stopped, " << state.memory.n_entries() << " meshes with " << (state.memory.size_bytes() >> 20) << " MB were cached..." << endl;
+    return true;
+}
+
+static int ConnectServer(const string &socket_path)
+{
+    sockaddr_un address;
+    if (!SocketAddress(socket_path, address))
+        return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0)
+        return fd;
+
+    cout << "Error: Couldn't connect to server at " << socket_path << ": " << strerror(errno) << "!" << endl;
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+bool RunClient(const string &socket_path, const string &input_filename, const string &output_filename)
+{
+    ifstream input_file(input_filename.c_str(), ios::binary);
+    if (!input_file.is_open())
+    {
+        cout << "Error: Couldn't open input file!" << endl;
+        return false;
+    }
+    ostringstream input_text;
+    input_text << input_file.rdbuf();
+
+    signal(SIGPIPE, SIG_IGN);
+    int fd = ConnectServer(socket_path);
+    if (fd < 0)
+        return false;
+    socket_connection connection(fd);
+    if (!connection.write(input_text.str() + "\nEND\n"))
+    {
+        cout << "Error: Couldn't send request to server!" << endl;
+        return false;
+    }
+
+    string line;
+    while (connection.read_line(line))
+    {
+        if (line.compare(0, 10, "RESULT OK ") == 0)
+        {
+            size_t n_nodes = 0, n_elements = 0, n_bytes = 0;
+            istringstream(line.substr(10)) >> n_nodes >> n_elements >> n_bytes;
+            ofstream output_file(output_filename.c_str(), ios::binary);
+            if (!connection.read_bytes(n_bytes, output_file))
+            {
+                cout << "Error: Couldn't receive mesh " << output_filename << "!" << endl;
+                return false;
+            }
+            cout << "Received mesh with " << n_nodes << " nodes and " << n_elements << " elements, written to " << output_filename << "..." << endl;
+            return true;
+        }
+        if (line.compare(0, 13, "RESULT ERROR ") == 0)
+        {
+            cout << "Error: " << line.substr(13) << "!" << endl;
+            return false;
+        }
+        if (line == string("BUSY"))
+        {
+            cout << "Error: Server is busy, try again later!" << endl;
+            return false;
+        }
+        cout << line << endl;
+    }
+
+    cout << "Error: Connection to server lost!" << endl;
+    return false;
+}
+
+bool StopServer(const string &socket_path)
+{
+    signal(SIGPIPE, SIG_IGN);
+    int fd = ConnectServer(socket_path);
+    if (fd < 0)
+        return false;
+    socket_connection connection(fd);
+
+    string reply;
+    if (!connection.write("SHUTDOWN\nEND\n") || !connection.read_line(reply) || reply != string("OK"))
+    {
+        cout << "Error: Server didn't confirm the shutdown!" << endl;
+        return false;
+    }
+    cout << "Server shutting down..." << endl;
+    return true;
+}
+
+#endif
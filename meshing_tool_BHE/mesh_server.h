@@ -0,0 +1,25 @@
+#ifndef MESH_SERVER_H
+#define MESH_SERVER_H
+
+#include <string>
+
+#include "pipeline.h"
+
+// Server mode: a long-running process meshing jobs sent over a Unix domain socket, with the
+// recently used planes and extruded meshes kept in memory between jobs.
+// A request is an input file (.inp syntax, or a JSON object {"KEYWORD": values, ...}) ended by
+// a line END or by closing the sending side. A request SHUTDOWN stops the server. Replies are lines:
+//   ACCEPTED id                    or BUSY if n_jobs are running and max_queued are waiting
+//   STARTED                        when one of the n_jobs slots is free
+//   PROGRESS stage seconds         after each pipeline stage
+//   RESULT OK nodes elements bytes followed by the .bhe.msh file of that many bytes
+//   RESULT ERROR message
+// Relative BHE_FILEs are read from the working directory of the server. Each job writes its files to a
+// directory bhe_server_<pid>_job<id> in the system temporary directory, removed when the job is done.
+bool RunServer(const std::string &socket_path, const run_options &options, const int n_jobs, const int max_queued, const size_t memory_megabytes);
+
+// Sends input_filename to the server, prints the progress and writes the mesh to output_filename
+bool RunClient(const std::string &socket_path, const std::string &input_filename, const std::string &output_filename);
+bool StopServer(const std::string &socket_path);
+
+#endif //MESH_SERVER_H
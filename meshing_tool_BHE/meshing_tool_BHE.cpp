@@ -23,7 +23,11 @@ BOX start length width
 ELEM_SIZE box corner
 LAYER mat_group number_of_elements element_thickness
 BHE BHE_number x-coord y-coord z_top z_bottom radius
+BHE_FILE csv_file (BHE_number, x, y, z_top, z_bottom, radius per line)
 ADD_POINT x y delta
+BHE_TOLERANCE tolerance (optional, default 1e-4)
+AUTO_LAYERS min_thickness growth_factor max_aspect_ratio (optional, LAYERs then give materials and depth only)
+SIZE_FIELD growth_rate max_size (optional, GMSH distance/threshold fields around the BHEs)
 ------------------------------------------------------------------------------
 */
 
@@ -31,310 +35,701 @@ ADD_POINT x y delta
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <unordered_map>
+
+#include "meshing_tool_BHE.h"
+#include "bhe_file.h"
+#include "boundary.h"
+#include "extruded_mesh.h"
+#include "instrumentation.h"
+#include "mapped_file.h"
+#include "mesh_cache.h"
+#include "mesh_quality.h"
+#include "msh_writer.h"
+#include "partition.h"
+#include "patch_mesher.h"
+#include "pipeline.h"
+#include "plane_mesher.h"
+#include "process.h"
+#include "renumbering.h"
+#include "spatial_hash.h"
+#include "text_output.h"
+#include "vtu_writer.h"
 
 using namespace std;
 
 // Prototypes
-struct bhe
-{
-    int bhe_number;
-    double bhe_x;
-    double bhe_y;
-    double bhe_top;
-    double bhe_bottom;
-    double bhe_radius;
-};
+vector<string> Tokenize(const string &line);
 
-struct node
+static double SecondsSince(const chrono::steady_clock::time_point &start)
 {
-    int node_number;
-    double node_x;
-    double node_y;
-    double node_z;
-};
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
 
-struct prism_element
+bool BuildMesh(const string &project_name, const model_description &model, const run_options &options, const run_context &context,
+               extruded_mesh &mesh, run_statistics &stats, run_report &report)
 {
-    int element_number;
-    int material_group;
-    string element_type = "pris";
-    int node1, node2, node3, node4, node5, node6;
-};
+    // Declarations
+    const geometry &geom = model.geom;
+    const vector<layer> &layers = model.layers;
+    const vector<bhe> &BHEs = model.BHEs;
+    const vector<additional_point> &add_points = model.add_points;
+    int cnt_mat_groups = 0;
+    chrono::steady_clock::time_point stage = chrono::steady_clock::now();
+    size_t id;
+
+    mesh = extruded_mesh();
+
+    // Cached results: the plane depends on the 2D inputs only, the extruded mesh also on layers and BHE depths
+    mesh_cache cache(options.cache_directory);
+    bool use_cache = !options.cache_directory.empty() && !options.gmsh_only;
+    uint64_t plane_key = PlaneKey(geom, BHEs, add_points, options.native_mesher, options.patch_arrays, options.recombine_quads);
+    uint64_t layout_key = LayoutKey(geom, add_points);
+    uint64_t extrusion_key = ExtrusionKey(plane_key, geom, layers, BHEs, options.renumber_plane, options.column_major);
+
+    // Warm meshes of a long-running process come first
+    bool use_memory = context.memory && !options.gmsh_only;
+    bool cached = false;
+    if (use_memory)
+    {
+        id = report.begin_stage("LoadExtrudedMemory");
+        cached = context.memory->get_extruded(extrusion_key, mesh);
+        report.end_stage(id);
+    }
+    if (use_cache && !cached)
+    {
+        id = report.begin_stage("LoadExtrudedCache");
+        uint64_t bytes_read = 0;
+        cached = cache.load_extruded(extrusion_key, mesh, &bytes_read);
+        report.add_bytes_read(id, bytes_read);
+        report.end_stage(id);
+        if (cached && use_memory)
+            context.memory->put_extruded(extrusion_key, mesh);
+    }
 
-struct bhe_element
-{
-    int element_number;
-    int material_group;
-    string element_type = "line";
-    int start_node;
-    int end_node;
-};
+    // Work that doesn't need the 2D mesh, done while gmsh runs or else after the plane is ready
+    bool independent_done = false, independent_ok = true, levels_before_plane = false;
+    auto independent_work = [&]() {
+        if (independent_done || options.gmsh_only)
+            return independent_ok;
+        independent_done = true;
 
-struct geometry
-{
-    double width, length, depth;
-    double box_start = -1, box_length = -1, box_width = -1;
-    double elem_size_box, elem_size_corner;
-};
+        size_t id;
+        if (options.write_gli)
+        {
+            uint64_t bytes_written = 0;
+            id = report.begin_stage("WriteGLI");
+            independent_ok = WriteGLI(project_name, geom, BHEs, add_points, &bytes_written);
+            report.add_bytes_written(id, bytes_written);
+            report.end_stage(id);
+        }
 
-struct layer
-{
-    int mat_group;
-    int n_elems;
-    double elem_thickness;
-};
+        if (independent_ok && !cached)
+        {
+            id = report.begin_stage("ExtrudeMesh");
+            levels_before_plane = (mesh.n_nodes_in_plane() == 0);
+            if (geom.auto_min_thickness > 0)
+                independent_ok = ExtrudeMeshGraded(mesh, geom, layers, BHEs, cnt_mat_groups);
+            else
+                independent_ok = ExtrudeMesh(mesh, layers, cnt_mat_groups);
+            report.add_count(id, "levels", mesh.n_levels());
+            report.end_stage(id);
+        }
 
-struct additional_point
-{
-    double x;
-    double y;
-    double z = 0;
-    double delta = 0;
-};
+        if (independent_ok && !cached)
+        {
+            id = report.begin_stage("ValidateBHEdepths");
+            independent_ok = ValidateBHEdepths(BHEs, mesh.z_levels, geom.bhe_tolerance);
+            report.end_stage(id);
+        }
 
-bool ReadInputFile(const string &input_filename, string &project_name, geometry &geom, vector<layer> &layers, vector<bhe> &BHEs, vector<additional_point> &add_points);
-bool WriteGMSHgeo(const string project_name, const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points);
-bool ExecuteGMSH(const string project_name);
-bool ImportGMSHmsh(const string project_name, vector<node> &nodes, vector<prism_element> &elements);
-bool ExtrudeMesh(vector<node> &nodes, vector<prism_element> &elements, vector<layer> &layers, int &cnt_mat_groups, int &cnt_elems);
-bool ComputeBHEelements(const vector<bhe> &BHEs, const vector<node> &nodes, vector<bhe_element> &bhe_elements, const int n_mat_groups, int &n_elems);
-bool WriteMesh(const string project_name, const vector<node> &nodes, const vector<prism_element> &prism_elements, const vector<bhe_element> &bhe_elements);
-bool WriteGLI(const string project_name, const geometry &geom, vector<bhe> &BHEs, const vector<additional_point> &add_points);
-vector<string> Tokenize(const string &line);
+        return independent_ok;
+    };
 
-int main(int argc, char *argv[])
-{
-    // Check input arguments
-    if (argc < 2 || argc > 3)
+    if (cached)
     {
-        cout << "Usage: bhe_setup_tool.exe input-filename (-2D)" << endl;
-        return 0;
+        cout << "Loaded extruded mesh from cache: " << mesh.n_nodes() << " nodes and " << mesh.n_elements() << " elements..." << endl;
+        stats.time_plane = SecondsSince(stage);
+
+        if (!independent_work())
+            return false;
     }
+    else
+    {
+        auto create_plane = [&](compact_mesh &plane) {
+            size_t id;
+            bool plane_cached = false;
+            if (use_memory)
+            {
+                id = report.begin_stage("LoadPlaneMemory");
+                plane_cached = context.memory->get_plane(plane_key, plane);
+                report.end_stage(id);
+            }
+            if (use_cache && !plane_cached)
+            {
+                id = report.begin_stage("LoadPlaneCache");
+                uint64_t bytes_read = 0;
+                plane_cached = cache.load_plane(plane_key, plane, &bytes_read);
+                report.add_bytes_read(id, bytes_read);
+                report.end_stage(id);
+                if (plane_cached && use_memory)
+                    context.memory->put_plane(plane_key, plane);
+            }
 
-    bool gmsh_only = false;
-    if (argc == 3 && (string(argv[2]) == string("-2D")))
-        gmsh_only = true;
+            if (plane_cached)
+            {
+                cout << "Loaded 2D mesh from cache: " << plane.n_nodes() << " nodes and " << plane.n_elements() << " elements..." << endl;
+                return true;
+            }
 
-    // Declarations
-    string input_filename = string(argv[1]);
-    vector<bhe> BHEs;
-    vector<node> nodes;
-    vector<prism_element> prism_elements;
-    vector<bhe_element> bhe_elements;
-    vector<layer> layers;
-    vector<additional_point> add_points;
-    geometry geom;
-    int cnt_mat_groups = 0, cnt_elems = 0;
+            // Incremental: the last plane of the layout, remeshed around the changed BHEs
+            bool remeshed = false;
+            if (options.incremental && use_cache)
+            {
+                vector<bhe> old_BHEs;
+                uint64_t bytes_read = 0;
+                id = report.begin_stage("RemeshPlaneLocally");
+                remeshed = cache.load_layout(layout_key, plane, old_BHEs, &bytes_read) && RemeshPlaneLocally(geom, old_BHEs, BHEs, add_points, plane);
+                report.add_bytes_read(id, bytes_read);
+                report.add_count(id, "nodes", plane.n_nodes());
+                report.add_count(id, "triangles", plane.n_elements());
+                report.end_stage(id);
+            }
 
-    string project_name = input_filename;
-    project_name.erase(project_name.end() - 4, project_name.end());
+            if (!remeshed && options.native_mesher)
+            {
+                // Built-in mesher instead of the GMSH round trip
+                id = report.begin_stage("MeshPlane");
+                if (!(options.patch_arrays ? MeshPlanePatched(geom, BHEs, add_points, plane) : MeshPlane(geom, BHEs, add_points, plane)))
+                    return false;
+                report.add_count(id, "nodes", plane.n_nodes());
+                report.add_count(id, "triangles", plane.n_elements());
+                report.end_stage(id);
+
+                if (options.gmsh_only)
+                {
+                    uint64_t bytes_written = 0;
+                    id = report.begin_stage("WriteVTU");
+                    bool vtu_ok = WriteVTU(project_name + "_2D", plane, &bytes_written);
+                    report.add_bytes_written(id, bytes_written);
+                    report.end_stage(id);
+                    return vtu_ok;
+                }
+            }
+            else if (!remeshed)
+            {
+                id = report.begin_stage("WriteGMSHgeo");
+                if (!WriteGMSHgeo(project_name, geom, BHEs, add_points, options.recombine_quads))
+                    return false;
+                report.add_bytes_written(id, FileBytes(project_name + ".geo"));
+                report.end_stage(id);
+
+                // Waiting for a free gmsh slot is part of the stage
+                id = report.begin_stage("ExecuteGMSH");
+                child_process gmsh;
+                if (context.gmsh_processes)
+                    context.gmsh_processes->acquire();
+                bool gmsh_ok = StartGMSH(project_name, options, gmsh);
+                bool other_ok = !gmsh_ok || independent_work();
+                gmsh_ok = gmsh_ok && WaitGMSH(project_name, options, gmsh);
+                if (context.gmsh_processes)
+                    context.gmsh_processes->release();
+                report.end_stage(id);
+
+                if (!gmsh_ok || !other_ok)
+                    return false;
+
+                if (options.gmsh_only)
+                    return true;
+
+                id = report.begin_stage("ImportGMSHmsh");
+                if (!ImportGMSHmsh(project_name, plane))
+                    return false;
+                report.add_bytes_read(id, FileBytes(project_name + ".msh"));
+                report.add_count(id, "nodes", plane.n_nodes());
+                report.add_count(id, "triangles", plane.n_elements());
+                report.end_stage(id);
+            }
 
+            if (use_cache)
+            {
+                id = report.begin_stage("StorePlaneCache");
+                if (!cache.store_plane(plane_key, plane))
+                    cout << "Warning: Couldn't store 2D mesh in cache " << options.cache_directory << "!" << endl;
+                report.end_stage(id);
+            }
+            if (use_memory)
+                context.memory->put_plane(plane_key, plane);
+            return true;
+        };
+
+        // Runs of a batch with the same plane share one 2D mesh
+        bool plane_ok;
+        if (context.planes && !options.gmsh_only)
+        {
+            id = report.begin_stage("SharedPlane");
+            plane_ok = context.planes->get(plane_key, mesh.plane, create_plane);
+            report.end_stage(id);
+        }
+        else
+            plane_ok = create_plane(mesh.plane);
 
-    if (!ReadInputFile(input_filename,project_name, geom, layers, BHEs, add_points))
-        return 0;
+        if (!plane_ok)
+            return false;
 
-    if (!WriteGMSHgeo(project_name, geom, BHEs, add_points))
-        return 0;
+        // Base of the next incremental run, before renumbering
+        if (options.incremental && use_cache)
+        {
+            id = report.begin_stage("StoreLayout");
+            if (!cache.store_layout(layout_key, mesh.plane, BHEs))
+                cout << "Warning: Couldn't store 2D mesh layout in cache " << options.cache_directory << "!" << endl;
+            report.end_stage(id);
+        }
 
-    if (!ExecuteGMSH(project_name))
-        return 0;
+        // Numbering is fixed before the BHE elements refer to nodes
+        if (options.renumber_plane && !options.gmsh_only)
+        {
+            id = report.begin_stage("RenumberPlane");
+            if (!RenumberPlane(mesh.plane))
+                return false;
+            report.end_stage(id);
+        }
+        mesh.column_major = options.column_major;
 
-    if (gmsh_only)
-        return 0;
+        stats.time_plane = SecondsSince(stage);
+        stats.n_plane_nodes = mesh.plane.n_nodes();
+        stats.n_plane_elements = mesh.plane.n_elements();
+        if (options.gmsh_only)
+            return true;
+        stage = chrono::steady_clock::now();
 
-    if (!ImportGMSHmsh(project_name, nodes, prism_elements))
-        return 0;
+        if (!independent_work())
+            return false;
+        if (levels_before_plane)
+            cout << "Extrusion of 2D mesh successful: Created " << mesh.n_nodes() << " nodes and " << mesh.n_prisms() << " elements..." << endl;
 
-    if (!ExtrudeMesh(nodes, prism_elements, layers, cnt_mat_groups, cnt_elems))
-        return 0;
+        id = report.begin_stage("ComputeBHEelements");
+        if (!ComputeBHEelements(BHEs, mesh, geom.bhe_tolerance, cnt_mat_groups))
+            return false;
+        report.add_count(id, "bhe_elements", mesh.n_bhe_elements());
+        report.end_stage(id);
 
-    if (!ComputeBHEelements(BHEs, nodes, bhe_elements, cnt_mat_groups, cnt_elems))
-        return 0;
+        if (use_cache)
+        {
+            id = report.begin_stage("StoreExtrudedCache");
+            if (!cache.store_extruded(extrusion_key, mesh))
+                cout << "Warning: Couldn't store extruded mesh in cache " << options.cache_directory << "!" << endl;
+            report.end_stage(id);
+        }
+        if (use_memory)
+            context.memory->put_extruded(extrusion_key, mesh);
 
-    if (!WriteMesh(project_name, nodes, prism_elements, bhe_elements))
-        return 0;
+        stats.time_extrude = SecondsSince(stage);
+    }
 
-    if (!WriteGLI(project_name, geom, BHEs, add_points))
-        return 0;
+    if (options.check_mesh)
+    {
+        mesh_quality quality;
+        id = report.begin_stage("CheckMesh");
+        bool mesh_ok = CheckMesh(mesh, BHEs, geom.bhe_tolerance, options.n_threads, quality);
+        report.add_count(id, "inverted_prisms", quality.n_inverted_prisms);
+        report.add_count(id, "degenerate_triangles", quality.n_degenerate_triangles);
+        report.add_count(id, "duplicate_nodes", quality.n_duplicate_nodes);
+        report.add_count(id, "unreferenced_nodes", quality.n_unreferenced_nodes);
+        report.end_stage(id);
+        if (!mesh_ok)
+            return false;
+    }
 
-    cout << "Program terminated normally..." << endl;
-    return 0;
+    stats.n_plane_nodes = mesh.plane.n_nodes();
+    stats.n_plane_elements = mesh.plane.n_elements();
+    stats.n_nodes = mesh.n_nodes();
+    stats.n_elements = mesh.n_elements();
+    return true;
 }
 
-bool ReadInputFile(const string &input_filename, string &project_name, geometry &geom, vector<layer> &layers, vector<bhe> &BHEs, vector<additional_point> &add_points)
+static bool RunStages(const string &input_filename, string &project_name, const run_options &options, const run_context &context, run_statistics &stats, run_report &report)
 {
     // Declarations
-    string line;
-    ifstream input_file(input_filename.c_str());
-    geometry this_geom;
-    int cnt_geo_param = 0;
+    model_description model;
+    extruded_mesh mesh;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    chrono::steady_clock::time_point stage = start;
+    size_t id;
+
+    // The input file and its BHE_FILEs
+    uint64_t bytes_read = 0;
+    id = report.begin_stage("ReadInputFile");
+    if (!ReadInputFile(input_filename, project_name, model.geom, model.layers, model.BHEs, model.add_points, &bytes_read))
+        return false;
+    report.add_bytes_read(id, bytes_read);
+    report.add_count(id, "bhes", model.BHEs.size());
+    report.add_count(id, "layers", model.layers.size());
+    report.end_stage(id);
 
-    // Try to open file
-    if (input_file.is_open())
+    stats.time_read = SecondsSince(stage);
+
+    if (!BuildMesh(project_name, model, options, context, mesh, stats, report))
+        return false;
+
+    if (options.gmsh_only)
     {
-        // Read lines
-        while (getline(input_file, line))
+        stats.ok = true;
+        stats.time_total = SecondsSince(start);
+        return true;
+    }
+    stage = chrono::steady_clock::now();
+
+    // Writes a mesh (extruded or materialized) in the requested formats
+    auto write_outputs = [&](const auto &output_mesh) {
+        uint64_t bytes_written = 0;
+        if (options.write_msh)
         {
-            bool cmd_understood = false;
+            id = report.begin_stage("WriteMesh");
+            if (!WriteMesh(project_name, output_mesh, options.n_threads, &bytes_written))
+                return false;
+            report.add_bytes_written(id, bytes_written);
+            report.add_count(id, "nodes", output_mesh.n_nodes());
+            report.add_count(id, "elements", output_mesh.n_elements());
+            report.end_stage(id);
+        }
 
-            // Get tokens
-            vector<string> tokens = Tokenize(line);
+        if (options.write_vtu)
+        {
+            bytes_written = 0;
+            id = report.begin_stage("WriteVTU");
+            if (!WriteVTU(project_name, output_mesh, &bytes_written))
+                return false;
+            report.add_bytes_written(id, bytes_written);
+            report.add_count(id, "nodes", output_mesh.n_nodes());
+            report.add_count(id, "elements", output_mesh.n_elements());
+            report.end_stage(id);
+        }
+        return true;
+    };
 
-            // Check keywords
+    if (options.materialize)
+    {
+        // Explicit 3D mesh, extruded level-parallel, instead of generating entities while writing
+        compact_mesh mesh_3D;
+        id = report.begin_stage("MaterializeMesh");
+        MaterializeMesh(mesh, mesh_3D, options.n_threads);
+        report.end_stage(id);
+        cout << "Materialized 3D mesh with " << mesh_3D.n_nodes() << " nodes and " << mesh_3D.n_elements() << " elements..." << endl;
+
+        if (!write_outputs(mesh_3D))
+            return false;
+    }
+    else if (!write_outputs(mesh))
+        return false;
 
-            if (tokens[0] == string("%") || tokens[0] == string(":") || tokens[0] == string(";") || tokens[0] == string("#") || tokens[0] == string("//") || tokens[0] == string("/*") || tokens[0] == string("7"))
-            {
-                cmd_understood = true;
-            }
+    if (options.n_plane_parts * options.n_level_parts > 1)
+    {
+        // Domain decomposition, always from the structured mesh
+        mesh_partitioning partitioning;
+        uint64_t bytes_written = 0;
+        id = report.begin_stage("WritePartitions");
+        if (!PartitionMesh(mesh, options.n_plane_parts, options.n_level_parts, partitioning) ||
+            !WritePartitions(project_name, mesh, partitioning, options.n_threads, &bytes_written))
+            return false;
+        report.add_bytes_written(id, bytes_written);
+        report.add_count(id, "partitions", partitioning.n_partitions());
+        report.end_stage(id);
+    }
 
-            if (tokens[0] == string("PROJECT"))
-            {
-                if (tokens.size() == 2)
-                {
-                    project_name = tokens[1];
-                    cmd_understood = true;
-                }
-            }
+    if (options.write_boundary)
+    {
+        // Boundary membership from the structured extrusion, no geometric search
+        vector<boundary_set> boundary_sets;
+        uint64_t bytes_written = 0;
+        id = report.begin_stage("WriteBoundarySets");
+        if (!ComputeBoundarySets(mesh, model.geom, model.geom.bhe_tolerance, boundary_sets) || !WriteBoundarySets(project_name, boundary_sets, &bytes_written))
+            return false;
+        for (int s = 0; s < n_boundary_surfaces; s++)
+            report.add_count(id, string(boundary_names[s]) + "_faces", boundary_sets[s].face_elements.size());
+        report.add_bytes_written(id, bytes_written);
+        report.end_stage(id);
+    }
 
-            if (tokens[0] == string("WIDTH"))
-            {
-                if (tokens.size() == 2)
-                {
-                    this_geom.width = atof(tokens[1].c_str());
-                    cmd_understood = true;
-                    cnt_geo_param++;
-                }
-            }
+    stats.time_write = SecondsSince(stage);
+    stats.time_total = SecondsSince(start);
+    stats.ok = true;
+    return true;
+}
 
-            if (tokens[0] == string("LENGTH"))
-            {
-                if (tokens.size() == 2)
-                {
-                    this_geom.length = atof(tokens[1].c_str());
-                    cmd_understood = true;
-                    cnt_geo_param++;
-                }
-            }
+bool RunPipeline(const string &input_filename, const run_options &options, const run_context &context, run_statistics &stats)
+{
+    run_report report;
+    string project_name = input_filename;
+    project_name.erase(project_name.end() - 4, project_name.end());
 
-            if (tokens[0] == string("DEPTH"))
-            {
-                if (tokens.size() == 2)
-                {
-                    this_geom.depth = atof(tokens[1].c_str());
-                    cmd_understood = true;
-                    cnt_geo_param++;
-                }
-            }
+    stats = run_statistics();
+    RunStages(input_filename, project_name, options, context, stats, report);
 
-            if (tokens[0] == string("BOX"))
-            {
-                if (tokens.size() == 4)
-                {
-                    this_geom.box_start = atof(tokens[1].c_str());
-                    this_geom.box_length = atof(tokens[2].c_str());
-                    this_geom.box_width = atof(tokens[3].c_str());
-                    cmd_understood = true;
-                }
-            }
+    // Report next to the outputs, also for failed runs
+    report.set_property("input", input_filename);
+    report.set_property("project", project_name);
+    report.set_property("mesher", options.native_mesher ? "native" : "gmsh");
+    report.set_property("threads", options.n_threads);
+    report.set_property("ok", stats.ok ? 1 : 0);
+    report.write_json(project_name + ".report.json");
 
-            if (tokens[0] == string("ELEM_SIZE"))
-            {
-                if (tokens.size() == 3)
-                {
-                    this_geom.elem_size_box = atof(tokens[1].c_str());
-                    this_geom.elem_size_corner = atof(tokens[2].c_str());
-                    cmd_understood = true;
-                    cnt_geo_param++;
-                }
-            }
+    return stats.ok;
+}
 
-            if (tokens[0] == string("LAYER"))
-            {
-                if (tokens.size() == 4)
-                {
-                    layer this_layer;
+// Parses a whole token as number
+template <typename T>
+static bool ParseToken(const string &token, T &value)
+{
+    const char *first = token.data(), *last = token.data() + token.size();
+    if (first < last && *first == '+')
+        first++;
+    from_chars_result result = from_chars(first, last, value);
+    return result.ec == errc() && result.ptr == last;
+}
 
-                    this_layer.mat_group = atoi(tokens[1].c_str());
-                    this_layer.n_elems = atoi(tokens[2].c_str());
-                    this_layer.elem_thickness = atof(tokens[3].c_str());
+// Input keyword: number of values after the keyword and the handler, false if the values are invalid
+struct input_keyword
+{
+    size_t n_values;
+    function<bool(const vector<string> &tokens)> parse;
+};
 
-                    cmd_understood = true;
+bool ReadInputStream(istream &input, const string &input_filename, string &project_name, geometry &geom, vector<layer> &layers, vector<bhe> &BHEs,
+                     vector<additional_point> &add_points, uint64_t *bytes_read)
+{
+    // Declarations
+    string line;
+    geometry this_geom;
+    int cnt_geo_param = 0;
+    bool bhe_file_ok = true, commands_ok = true;
+    size_t line_number = 0;
+
+    // Required geometry parameters count only once they are parsed
+    auto count_geometry = [&](bool ok) {
+        cnt_geo_param += ok ? 1 : 0;
+        return ok;
+    };
+
+    // Keyword dispatch table
+    const unordered_map<string, input_keyword> keywords = {
+        { "PROJECT", { 1, [&](const vector<string> &tokens) { project_name = tokens[1]; return true; } } },
+        { "WIDTH", { 1, [&](const vector<string> &tokens) { return count_geometry(ParseToken(tokens[1], this_geom.width)); } } },
+        { "LENGTH", { 1, [&](const vector<string> &tokens) { return count_geometry(ParseToken(tokens[1], this_geom.length)); } } },
+        { "DEPTH", { 1, [&](const vector<string> &tokens) { return count_geometry(ParseToken(tokens[1], this_geom.depth)); } } },
+        { "BOX", { 3, [&](const vector<string> &tokens) {
+              return ParseToken(tokens[1], this_geom.box_start) && ParseToken(tokens[2], this_geom.box_length) && ParseToken(tokens[3], this_geom.box_width);
+          } } },
+        { "ELEM_SIZE", { 2, [&](const vector<string> &tokens) {
+              return count_geometry(ParseToken(tokens[1], this_geom.elem_size_box) && ParseToken(tokens[2], this_geom.elem_size_corner));
+          } } },
+        { "LAYER", { 3, [&](const vector<string> &tokens) {
+              layer this_layer;
+              bool ok = ParseToken(tokens[1], this_layer.mat_group) && ParseToken(tokens[2], this_layer.n_elems) && ParseToken(tokens[3], this_layer.elem_thickness);
+              if (ok)
+                  layers.push_back(this_layer);
+              return ok;
+          } } },
+        { "BHE", { 6, [&](const vector<string> &tokens) {
+              bhe this_BHE;
+              bool ok = ParseToken(tokens[1], this_BHE.bhe_number) && ParseToken(tokens[2], this_BHE.bhe_x) && ParseToken(tokens[3], this_BHE.bhe_y) &&
+                        ParseToken(tokens[4], this_BHE.bhe_top) && ParseToken(tokens[5], this_BHE.bhe_bottom) && ParseToken(tokens[6], this_BHE.bhe_radius);
+              if (ok)
+                  BHEs.push_back(this_BHE);
+              return ok;
+          } } },
+        { "BHE_FILE", { 1, [&](const vector<string> &tokens) {
+              // Relative to the input file
+              filesystem::path bhe_filename(tokens[1]);
+              if (bhe_filename.is_relative())
+                  bhe_filename = filesystem::path(input_filename).parent_path() / bhe_filename;
+              bhe_file_ok = ReadBHEfile(bhe_filename.string(), BHEs, bytes_read) && bhe_file_ok;
+              return true;
+          } } },
+        { "BHE_TOLERANCE", { 1, [&](const vector<string> &tokens) { return ParseToken(tokens[1], this_geom.bhe_tolerance) && this_geom.bhe_tolerance > 0; } } },
+        { "AUTO_LAYERS", { 3, [&](const vector<string> &tokens) {
+              return ParseToken(tokens[1], this_geom.auto_min_thickness) && ParseToken(tokens[2], this_geom.auto_growth) &&
+                     ParseToken(tokens[3], this_geom.auto_max_aspect) && this_geom.auto_min_thickness > 0 && this_geom.auto_growth >= 1 && this_geom.auto_max_aspect > 0;
+          } } },
+        { "SIZE_FIELD", { 2, [&](const vector<string> &tokens) {
+              return ParseToken(tokens[1], this_geom.field_growth) && ParseToken(tokens[2], this_geom.field_max_size) && this_geom.field_growth > 0 &&
+                     this_geom.field_max_size > 0;
+          } } },
+        { "ADD_POINT", { 3, [&](const vector<string> &tokens) {
+              additional_point this_point;
+              bool ok = ParseToken(tokens[1], this_point.x) && ParseToken(tokens[2], this_point.y) && ParseToken(tokens[3], this_point.delta);
+              if (ok)
+                  add_points.push_back(this_point);
+              return ok;
+          } } },
+    };
+
+    // Read lines
+    while (getline(input, line))
+    {
+        line_number++;
+        if (bytes_read)
+            *bytes_read += line.size() + (input.eof() ? 0 : 1);
 
-                    layers.push_back(this_layer);
-                }
-            }
+        // Get tokens, skip blank lines and comments
+        vector<string> tokens = Tokenize(line);
+        if (tokens.empty())
+            continue;
 
-            if (tokens[0] == string("BHE"))
-            {
-                if (tokens.size() == 7)
-                {
-                    bhe this_BHE;
+        const string &first = tokens[0];
+        if (first[0] == '%' || first[0] == ':' || first[0] == ';' || first[0] == '#' || first.compare(0, 2, "//") == 0 || first.compare(0, 2, "/*") == 0)
+            continue;
 
-                    this_BHE.bhe_number = atoi(tokens[1].c_str());
-                    this_BHE.bhe_x = atof(tokens[2].c_str());
-                    this_BHE.bhe_y = atof(tokens[3].c_str());
-                    this_BHE.bhe_top = atof(tokens[4].c_str());
-                    this_BHE.bhe_bottom = atof(tokens[5].c_str());
-                    this_BHE.bhe_radius = atof(tokens[6].c_str());
-                    cmd_understood = true;
+        auto keyword = keywords.find(first);
+        if (keyword == keywords.end() || tokens.size() != keyword->second.n_values + 1 || !keyword->second.parse(tokens))
+        {
+            cout << "Error: Couldn't understand command " << line << " in line " << line_number << "!" << endl;
+            commands_ok = false;
+        }
+    }
 
-                    BHEs.push_back(this_BHE);
-                }
-            }
+    geom = this_geom;
 
-            if (tokens[0] == string("ADD_POINT"))
-            {
-                if (tokens.size() == 4)
-                {
-                    additional_point this_point;
+    // Unknown keywords, wrong value counts and invalid numbers fail the whole input
+    if (!bhe_file_ok || !commands_ok)
+        return false;
 
-                    this_point.x = atof(tokens[1].c_str());
-                    this_point.y = atof(tokens[2].c_str());
-                    this_point.delta = atof(tokens[3].c_str());
-                    cmd_understood = true;
+    if (BHEs.size() == 0)
+    {
+        cout << "Error: No BHEs defined!" << endl;
+        return false;
+    }
 
-                    add_points.push_back(this_point);
-                }
-            }
+    if (!CheckBHEs(BHEs))
+        return false;
 
-            if (!cmd_understood)
-                cout << "Error: Couldn't understand command " << line << "!" << endl;
-        }
+    if (layers.size() == 0)
+    {
+        cout << "Error: No layers defined!" << endl;
+        return false;
+    }
 
-        geom = this_geom;
+    if (cnt_geo_param != 4)
+    {
+        cout << "Error: Definition of geometry incomplete!" << endl;
+        return false;
+    }
 
-        input_file.close();
+    cout << "Reading input file " << input_filename << " successful..." << endl;
+    return true;
+}
 
-        if (BHEs.size() == 0)
-        {
-            cout << "Error: No BHEs defined!" << endl;
-            return false;
-        }
+bool ReadInputFile(const string &input_filename, string &project_name, geometry &geom, vector<layer> &layers, vector<bhe> &BHEs, vector<additional_point> &add_points,
+                   uint64_t *bytes_read)
+{
+    ifstream input_file(input_filename.c_str());
+    if (!input_file.is_open())
+    {
+        cout << "Error: Couldn't open input file!" << endl;
+        return false;
+    }
+    return ReadInputStream(input_file, input_filename, project_name, geom, layers, BHEs, add_points, bytes_read);
+}
 
-        if (layers.size() == 0)
-        {
-            cout << "Error: No layers defined!" << endl;
-            return false;
-        }
+// Appends "name[] = {values};" with values in shortest round-trip format
+static void WriteGeoList(ofstream &geo_file, const char *name, const vector<double> &values)
+{
+    text_buffer buffer;
+    buffer.put(name).put("[] = {");
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (i > 0)
+            buffer.put(i % 10 == 0 ? ",\n    " : ", ");
+        buffer.put(values[i]);
+    }
+    buffer.put("};\n");
+    geo_file.write(buffer.data(), buffer.size());
+}
 
-        if (cnt_geo_param != 4)
+// BHE points as coordinate lists expanded by For loops, one group per hexagon size,
+// and Distance/Threshold fields around the BHE centers combined by a Min background field
+static void WriteGMSHfields(ofstream &geo_file, const geometry &geom, const vector<bhe> &BHEs)
+{
+    map<double, vector<size_t>> groups;
+    for (size_t i = 0; i < BHEs.size(); i++)
+        groups[bhe_alpha * BHEs[i].bhe_radius].push_back(i);
+
+    geo_file << "// BHE hexagons" << endl;
+    WriteGeoList(geo_file, "hex_x", vector<double>(bhe_hexagon_x, bhe_hexagon_x + 6));
+    WriteGeoList(geo_file, "hex_y", vector<double>(bhe_hexagon_y, bhe_hexagon_y + 6));
+    geo_file << "bhe_points[] = {};" << endl << endl;
+
+    int group = 0, field = 0;
+    string fields_list;
+    for (const auto &this_group : groups)
+    {
+        double delta = this_group.first;
+        vector<double> x, y;
+        for (size_t i : this_group.second)
         {
-            cout << "Error: Definition of geometry incomplete!" << endl;
-            return false;
+            x.push_back(BHEs[i].bhe_x);
+            y.push_back(BHEs[i].bhe_y);
         }
 
-        cout << "Reading input file " << input_filename << " successful..." << endl;
-        return true;
+        string suffix = to_string(++group);
+        geo_file << "// " << x.size() << " BHEs with hexagon size " << delta << endl;
+        geo_file << "delta_" << suffix << " = " << delta << ";" << endl;
+        WriteGeoList(geo_file, ("bhe_x_" + suffix).c_str(), x);
+        WriteGeoList(geo_file, ("bhe_y_" + suffix).c_str(), y);
+        geo_file << "centers_" << suffix << "[] = {};" << endl;
+        geo_file << "For i In {0 : #bhe_x_" << suffix << "[] - 1}" << endl;
+        geo_file << "    p = newp; Point(p) = {bhe_x_" << suffix << "[i], bhe_y_" << suffix << "[i], 0.0, delta_" << suffix << "};" << endl;
+        geo_file << "    centers_" << suffix << "[] += {p}; bhe_points[] += {p};" << endl;
+        geo_file << "    For k In {0 : 5}" << endl;
+        geo_file << "        p = newp; Point(p) = {bhe_x_" << suffix << "[i] + hex_x[k] * delta_" << suffix << ", bhe_y_" << suffix << "[i] + hex_y[k] * delta_" << suffix
+                 << ", 0.0, delta_" << suffix << "};" << endl;
+        geo_file << "        bhe_points[] += {p};" << endl;
+        geo_file << "    EndFor" << endl;
+        geo_file << "EndFor" << endl;
+
+        // Size grows linearly with the distance from the hexagon up to the maximum size
+        double max_size = max(geom.field_max_size, delta);
+        geo_file << "Field[" << ++field << "] = Distance;" << endl;
+        geo_file << "Field[" << field << "].PointsList = {centers_" << suffix << "[]};" << endl;
+        geo_file << "Field[" << ++field << "] = Threshold;" << endl;
+        geo_file << "Field[" << field << "].InField = " << field - 1 << ";" << endl;
+        geo_file << "Field[" << field << "].SizeMin = delta_" << suffix << ";" << endl;
+        geo_file << "Field[" << field << "].SizeMax = " << max_size << ";" << endl;
+        geo_file << "Field[" << field << "].DistMin = delta_" << suffix << ";" << endl;
+        geo_file << "Field[" << field << "].DistMax = delta_" << suffix << " + " << (max_size - delta) / geom.field_growth << ";" << endl << endl;
+        fields_list.append(fields_list.empty() ? "" : ", ").append(to_string(field));
     }
 
-    cout << "Error: Couldn't open input file!" << endl;
-    return false;
+    if (!(geom.box_length == -1 || geom.box_start == -1 || geom.box_width == -1))
+    {
+        geo_file << "Field[" << ++field << "] = Box;" << endl;
+        geo_file << "Field[" << field << "].VIn = elem_size_box;" << endl;
+        geo_file << "Field[" << field << "].VOut = " << geom.field_max_size << ";" << endl;
+        geo_file << "Field[" << field << "].XMin = -box_width/2.0; Field[" << field << "].XMax = box_width/2.0;" << endl;
+        geo_file << "Field[" << field << "].YMin = box_start; Field[" << field << "].YMax = box_start + box_length;" << endl;
+        fields_list.append(fields_list.empty() ? "" : ", ").append(to_string(field));
+    }
+
+    geo_file << "Field[" << ++field << "] = Min;" << endl;
+    geo_file << "Field[" << field << "].FieldsList = {" << fields_list << "};" << endl;
+    geo_file << "Background Field = " << field << ";" << endl;
+    geo_file << "Mesh.MeshSizeExtendFromBoundary = 0;" << endl;
+    geo_file << "Point{bhe_points[]} In Surface{1};" << endl << endl;
 }
 
-bool WriteGMSHgeo(const string project_name, const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points)
+bool WriteGMSHgeo(const string project_name, const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points, const bool recombine)
 {
     int i;
-    int n_BHEs = BHEs.size();
+    int n_BHEs = (geom.field_growth > 0) ? 0 : BHEs.size();     // size fields write the BHEs as lists
     int n_add_points = add_points.size();
     int cnt_pnt = 9;
 
@@ -382,12 +777,10 @@ bool WriteGMSHgeo(const string project_name, const geometry &geom, const vector<
 
 
         // Write BHEs
-        // Currently fixed with n=6 nodes
-        double alpha = 6.134;
         string point_list = "";
         for (i = 0; i < n_BHEs; i++)
         {
-            double delta = alpha * BHEs[i].bhe_radius;
+            double delta = bhe_alpha * BHEs[i].bhe_radius;
 
             geo_file << "// BHE #" << BHEs[i].bhe_number << endl;
             geo_file << "Point(" << cnt_pnt << ") = {" << BHEs[i].bhe_x << ", " << BHEs[i].bhe_y << ", 0.0, " << delta << "};" << endl; point_list.append(to_string(cnt_pnt++)); point_list.append(", ");
@@ -419,7 +812,19 @@ bool WriteGMSHgeo(const string project_name, const geometry &geom, const vector<
                     point_list.append(", ");
             }
 
-        geo_file << "Point{" << point_list << "} In Surface{1};" << endl << endl;
+        if (!point_list.empty())
+            geo_file << "Point{" << point_list << "} In Surface{1};" << endl << endl;
+
+        // After all numbered points, the lists use newp
+        if (geom.field_growth > 0)
+            WriteGMSHfields(geo_file, geom, BHEs);
+
+        if (recombine)
+        {
+            geo_file << "// quadrilateral-dominant mesh" << endl;
+            geo_file << "Mesh.Algorithm = 8;" << endl;
+            geo_file << "Mesh.RecombineAll = 1;" << endl;
+        }
 
         geo_file.close();
 
@@ -431,124 +836,394 @@ bool WriteGMSHgeo(const string project_name, const geometry &geom, const vector<
     return false;
 }
 
-bool ExecuteGMSH(const string project_name)
+bool StartGMSH(const string project_name, const run_options &options, child_process &gmsh)
 {
-    string gmsh_path = "";
-    string gmsh_call = gmsh_path;
-    gmsh_call.append("gmsh.exe ");
-    gmsh_call.append(project_name);
-    gmsh_call.append(".geo -2 -format msh2");
-
-    try
+    vector<string> args = { options.gmsh_path, project_name + ".geo", "-2", "-format", "msh2", "-bin" };
+    if (options.gmsh_threads > 0)
     {
-        cout << "Calling gmsh.exe..." << endl;
-        system(gmsh_call.c_str());
+        args.push_back("-nt");
+        args.push_back(to_string(options.gmsh_threads));
     }
-    catch (...)
+
+    cout << "Calling " << options.gmsh_path << "..." << endl;
+    if (!gmsh.start(args, project_name + ".gmsh.log"))
     {
-        cout << "Error: Couldn't find gmsh.exe in this directory!";
+        cout << "Error: Couldn't start " << options.gmsh_path << "!" << endl;
         return false;
     }
 
-    cout << "Calling gmsh.exe successful..." << endl;
     return true;
 }
 
-bool ImportGMSHmsh(const string project_name, vector<node> &nodes, vector<prism_element> &elements)
+// Last lines of the captured GMSH output
+static void PrintLogTail(const string &log_filename, size_t n_lines)
 {
-    // Declarations
+    ifstream log_file(log_filename.c_str());
+    vector<string> lines;
     string line;
-    string mesh_filename = project_name;
-    mesh_filename.append(".msh");
-    ifstream mesh_file(mesh_filename.c_str());
-    bool is_node = false;
-    bool is_element = false;
-    int cnt_elem = 0;
 
-    // Try to open file
-    if (mesh_file.is_open())
+    while (getline(log_file, line))
     {
-        // Read lines
-        while (getline(mesh_file, line))
+        lines.push_back(line);
+        if (lines.size() > n_lines)
+            lines.erase(lines.begin());
+    }
+
+    for (size_t i = 0; i < lines.size(); i++)
+        cout << "  " << lines[i] << endl;
+}
+
+bool WaitGMSH(const string project_name, const run_options &options, child_process &gmsh)
+{
+    int exit_code = 0;
+    bool timed_out = false;
+
+    if (!gmsh.wait(options.gmsh_timeout, exit_code, timed_out))
+    {
+        if (timed_out)
+            cout << "Error: " << options.gmsh_path << " didn't finish within " << options.gmsh_timeout << " s and was stopped!" << endl;
+        else
+            cout << "Error: Lost track of " << options.gmsh_path << "!" << endl;
+        return false;
+    }
+
+    if (exit_code != 0)
+    {
+        cout << "Error: " << options.gmsh_path << " failed with exit code " << exit_code << ", output in " << project_name << ".gmsh.log:" << endl;
+        PrintLogTail(project_name + ".gmsh.log", 10);
+        return false;
+    }
+
+    cout << "Calling " << options.gmsh_path << " successful..." << endl;
+    return true;
+}
+
+bool ValidateBHEdepths(const vector<bhe> &BHEs, const vector<double> &z_levels, const double tolerance)
+{
+    bool ok = true;
+
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        double top = BHEs[i].bhe_top, bottom = BHEs[i].bhe_bottom;
+
+        if (top < bottom)
+        {
+            cout << "Error: Top of BHE #" << BHEs[i].bhe_number << " is below its bottom!" << endl;
+            ok = false;
+            continue;
+        }
+        if (top > z_levels.front() + tolerance || bottom < z_levels.back() - tolerance)
         {
-            // Get tokens
-            vector<string> tokens = Tokenize(line);
+            cout << "Warning: BHE #" << BHEs[i].bhe_number << " reaches outside the layers (" << z_levels.back() << " to " << z_levels.front() << "), the BHE is shortened!" << endl;
+            continue;
+        }
 
-            // Check keywords
-            if (tokens[0] == string("$Nodes"))
-            {
-                is_element = false;
-                is_node = true;
-            }
+        // BHE elements follow the levels, ends between levels shorten the BHE
+        auto on_level = [&](double z) {
+            return any_of(z_levels.begin(), z_levels.end(), [&](double level) { return fabs(level - z) <= tolerance; });
+        };
+        if (!on_level(top) || !on_level(bottom))
+            cout << "Warning: Top or bottom of BHE #" << BHEs[i].bhe_number << " is not on a layer boundary, the BHE is shortened to the enclosed levels!" << endl;
+    }
+
+    return ok;
+}
+
+// Number of nodes per GMSH (msh2) element type, index = element type
+static const int gmsh_nodes_per_element[] = { 0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18, 14, 1, 8, 20, 15, 13, 9, 10, 12, 15, 15, 21, 4, 5, 6, 20, 35, 56 };
+static const int n_gmsh_element_types = sizeof(gmsh_nodes_per_element) / sizeof(int);
+
+// Cursor helpers for parsing the memory mapped GMSH file without allocations
+static void SkipBlanks(const char *&pos, const char *end)
+{
+    while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r'))
+        pos++;
+}
+
+static void SkipLine(const char *&pos, const char *end)
+{
+    const char *eol = static_cast<const char *>(memchr(pos, '\n', end - pos));
+    pos = (eol == nullptr) ? end : eol + 1;
+}
+
+static bool ParseInt(const char *&pos, const char *end, int &value)
+{
+    SkipBlanks(pos, end);
+    if (pos < end && *pos == '+')
+        pos++;
+    from_chars_result result = from_chars(pos, end, value);
+    if (result.ec != errc())
+        return false;
+    pos = result.ptr;
+    return true;
+}
+
+static bool ParseDouble(const char *&pos, const char *end, double &value)
+{
+    SkipBlanks(pos, end);
+    if (pos < end && *pos == '+')
+        pos++;
+    from_chars_result result = from_chars(pos, end, value);
+    if (result.ec != errc())
+        return false;
+    pos = result.ptr;
+    return true;
+}
+
+static bool ReadBinaryInts(const char *&pos, const char *end, int *values, int n)
+{
+    size_t n_bytes = n * sizeof(int);
+    if (static_cast<size_t>(end - pos) < n_bytes)
+        return false;
+    memcpy(values, pos, n_bytes);
+    pos += n_bytes;
+    return true;
+}
+
+// Compares the section keyword at pos (without the leading '$') and advances behind it
+static bool MatchSection(const char *&pos, const char *end, const char *keyword)
+{
+    size_t len = strlen(keyword);
+    if (static_cast<size_t>(end - pos) < len || memcmp(pos, keyword, len) != 0)
+        return false;
+    const char *after = pos + len;
+    if (after < end && !(*after == '\n' || *after == '\r' || *after == ' ' || *after == '\t'))
+        return false;
+    pos = after;
+    return true;
+}
+
+static bool ReadGMSHnodes(const char *&pos, const char *end, bool binary, compact_mesh &plane)
+{
+    int n_nodes;
+    if (!ParseInt(pos, end, n_nodes) || n_nodes < 0)
+        return false;
+    SkipLine(pos, end);
+
+    plane.x.reserve(plane.n_nodes() + n_nodes);
+    plane.y.reserve(plane.n_nodes() + n_nodes);
+    plane.z.reserve(plane.n_nodes() + n_nodes);
+
+    for (int i = 0; i < n_nodes; i++)
+    {
+        double coords[3];
+        int number;
+
+        if (binary)
+        {
+            if (!ReadBinaryInts(pos, end, &number, 1) || static_cast<size_t>(end - pos) < sizeof(coords))
+                return false;
+            memcpy(coords, pos, sizeof(coords));
+            pos += sizeof(coords);
+        }
+        else
+        {
+            if (!ParseInt(pos, end, number) || !ParseDouble(pos, end, coords[0]) || !ParseDouble(pos, end, coords[1]) || !ParseDouble(pos, end, coords[2]))
+                return false;
+            SkipLine(pos, end);
+        }
+
+        // The extrusion addresses nodes by index, so GMSH numbering has to be contiguous
+        if (number - 1 != static_cast<int>(plane.n_nodes()))
+        {
+            cout << "Error: Non-contiguous node numbering in GMSH mesh at node " << number << "!" << endl;
+            return false;
+        }
+
+        plane.add_node(coords[0], coords[1], coords[2]);
+    }
+
+    return true;
+}
+
+static bool ReadGMSHelements(const char *&pos, const char *end, bool binary, compact_mesh &plane)
+{
+    int n_elements;
+    if (!ParseInt(pos, end, n_elements) || n_elements < 0)
+        return false;
+    SkipLine(pos, end);
+
+    // Upper bound, the mesh also contains points and lines
+    plane.material_groups.reserve(plane.n_elements() + n_elements);
+    plane.connectivity.reserve(plane.n_connectivity() + 3 * static_cast<size_t>(n_elements));
+
+    int cnt_read = 0;
+    int buffer[64];
+    vector<uint32_t> quads;
+
+    while (cnt_read < n_elements)
+    {
+        int type, n_in_group, n_tags;
+
+        if (binary)
+        {
+            // Binary elements come in groups with a common header
+            int header[3];
+            if (!ReadBinaryInts(pos, end, header, 3))
+                return false;
+            type = header[0];
+            n_in_group = header[1];
+            n_tags = header[2];
+        }
+        else
+        {
+            int number;
+            if (!ParseInt(pos, end, number) || !ParseInt(pos, end, type) || !ParseInt(pos, end, n_tags))
+                return false;
+            n_in_group = 1;
+        }
+
+        if (type <= 0 || type >= n_gmsh_element_types || n_tags < 0 || n_in_group <= 0 || cnt_read + n_in_group > n_elements)
+            return false;
+
+        int n_values = 1 + n_tags + gmsh_nodes_per_element[type];
+        if (n_values > 64)
+            return false;
+
+        for (int j = 0; j < n_in_group; j++)
+        {
+            int *element_nodes = buffer + 1 + n_tags;
 
-            if (tokens[0] == string("$EndNodes"))
+            if (binary)
             {
-                is_element = false;
-                is_node = false;
+                if (!ReadBinaryInts(pos, end, buffer, n_values))
+                    return false;
             }
-
-            if (tokens[0] == string("$Elements"))
+            else
             {
-                is_element = true;
-                is_node = false;
+                // Element number was already read with the element header
+                for (int k = 1; k < n_values; k++)
+                    if (!ParseInt(pos, end, buffer[k]))
+                        return false;
+                SkipLine(pos, end);
             }
 
-            if (tokens[0] == string("$EndElements"))
+            // Keep triangles and quadrilaterals only
+            if (type == 2 || type == 3)
             {
-                is_element = false;
-                is_node = false;
+                uint32_t face[4];
+                for (int k = 0; k < type + 1; k++)
+                {
+                    if (element_nodes[k] < 1 || element_nodes[k] > static_cast<int>(plane.n_nodes()))
+                        return false;
+                    face[k] = element_nodes[k] - 1;
+                }
+
+                if (type == 2)
+                    plane.add_element(element_type::tri, face, 0);
+                else
+                    quads.insert(quads.end(), face, face + 4);
             }
+        }
 
-            // Read nodes
-            if (is_node && tokens.size() == 4)
-            {
-                node this_node;
+        cnt_read += n_in_group;
+    }
 
-                this_node.node_number = atoi(tokens[0].c_str())-1;
-                this_node.node_x = atof(tokens[1].c_str());
-                this_node.node_y = atof(tokens[2].c_str());
-                this_node.node_z = atof(tokens[3].c_str());
+    // Quadrilaterals after the triangles, one block each
+    for (size_t k = 0; k < quads.size(); k += 4)
+        plane.add_element(element_type::quad, quads.data() + k, 0);
 
-                nodes.push_back(this_node);
-            }
+    return true;
+}
 
-            // Read elements
-            if (is_element && tokens.size() == 8 && atoi(tokens[1].c_str()) == 2)
-            {
-                prism_element this_element;
+bool ImportGMSHmsh(const string project_name, compact_mesh &plane)
+{
+    // Declarations
+    string mesh_filename = project_name;
+    mesh_filename.append(".msh");
+    mapped_file mesh_file;
+    bool binary = false;
 
-                int shift = atoi(tokens[2].c_str());
+    // Try to open file
+    if (!mesh_file.open(mesh_filename))
+    {
+        cout << "Error: Couldn't open mesh file!" << endl;
+        return false;
+    }
 
-                this_element.element_number = cnt_elem++;
-                this_element.material_group = 0;
-                this_element.node1 = atoi(tokens[3+shift].c_str())-1;
-                this_element.node2 = atoi(tokens[4+shift].c_str())-1;
-                this_element.node3 = atoi(tokens[5+shift].c_str())-1;
-                this_element.node4 = 0;
-                this_element.node5 = 0;
-                this_element.node6 = 0;
+    const char *pos = mesh_file.begin();
+    const char *end = mesh_file.end();
+    bool ok = true;
 
-                elements.push_back(this_element);
-            }
+    // Scan for sections, everything outside of $Nodes and $Elements is skipped
+    while (ok && pos < end)
+    {
+        SkipBlanks(pos, end);
+        if (pos >= end || *pos != '$')
+        {
+            SkipLine(pos, end);
+            continue;
         }
+        pos++;
 
-        mesh_file.close();
+        if (MatchSection(pos, end, "MeshFormat"))
+        {
+            double version;
+            int file_type, data_size;
 
-        cout << "Importing 2D mesh " << mesh_filename << " successful..." << endl;
-        return true;
+            SkipLine(pos, end);
+            ok = ParseDouble(pos, end, version) && ParseInt(pos, end, file_type) && ParseInt(pos, end, data_size);
+            if (!ok)
+                break;
+            SkipLine(pos, end);
+
+            if (version < 2.0 || version >= 3.0)
+            {
+                cout << "Error: Only GMSH mesh format 2 is supported, found " << version << "!" << endl;
+                return false;
+            }
+
+            binary = (file_type == 1);
+            if (binary)
+            {
+                // Binary files start with the integer 1 to detect the byte order
+                int one;
+                if (data_size != sizeof(double) || !ReadBinaryInts(pos, end, &one, 1) || one != 1)
+                {
+                    cout << "Error: Unsupported binary layout in GMSH mesh file!" << endl;
+                    return false;
+                }
+                SkipLine(pos, end);
+            }
+        }
+        else if (MatchSection(pos, end, "Nodes"))
+        {
+            SkipLine(pos, end);
+            ok = ReadGMSHnodes(pos, end, binary, plane);
+        }
+        else if (MatchSection(pos, end, "Elements"))
+        {
+            SkipLine(pos, end);
+            ok = ReadGMSHelements(pos, end, binary, plane);
+        }
+        else
+            SkipLine(pos, end);
     }
 
-    cout << "Error: Couldn't open mesh file!" << endl;
-    return false;
+    if (!ok)
+    {
+        cout << "Error: Corrupt GMSH mesh file " << mesh_filename << " at byte " << (pos - mesh_file.begin()) << "!" << endl;
+        return false;
+    }
+
+    cout << "Importing 2D mesh " << mesh_filename << " successful..." << endl;
+    return true;
 }
 
-bool ExtrudeMesh(vector<node> &nodes, vector<prism_element> &elements, vector<layer> &layers, int &cnt_mat_groups, int &cnt_elems)
+bool ExtrudeMesh(extruded_mesh &mesh, const vector<layer> &layers, int &cnt_mat_groups)
 {
-    int i, j, k;
+    int i, j;
     int n_layers = layers.size();
-    int n_nodes_in_plane = nodes.size();
-    int n_elems_in_plane = elements.size();
-    int cnt = 1;
+    size_t n_elem_levels = 0;
+
+    for (i = 0; i < n_layers; i++)
+        n_elem_levels += max(0, layers[i].n_elems);
+
+    // The 2D mesh is the top level at z = 0
+    mesh.z_levels.assign(1, 0.0);
+    mesh.z_levels.reserve(n_elem_levels + 1);
+    mesh.level_mat_groups.clear();
+    mesh.level_mat_groups.reserve(n_elem_levels);
 
     // Loop over layers
     for (i = 0; i < n_layers; i++)
@@ -557,70 +1232,162 @@ bool ExtrudeMesh(vector<node> &nodes, vector<prism_element> &elements, vector<la
         int mat_group = layers[i].mat_group;
         double z_shift = layers[i].elem_thickness;
 
+        if (mat_group < 0 || mat_group > UINT16_MAX)
+        {
+            cout << "Error: Material group " << mat_group << " of layer " << i << " out of range!" << endl;
+            return false;
+        }
+
         if (mat_group > cnt_mat_groups)
             cnt_mat_groups = mat_group;
 
-        // Loop over elements per layer
+        // Loop over elements per layer, nodes and prisms are generated on access
         for (j = 0; j < n_elems; j++)
         {
-            // Create nodes
-            for (k = 0; k < n_nodes_in_plane; k++)
-            {
-                int idx_new = cnt*n_nodes_in_plane + k;
-                int idx_old = (cnt - 1)*n_nodes_in_plane + k;
+            mesh.z_levels.push_back(mesh.z_levels.back() - z_shift);
+            mesh.level_mat_groups.push_back(static_cast<uint16_t>(mat_group));
+        }
+    }
 
-                nodes.push_back(nodes[idx_old]);
-                nodes[idx_new].node_z -= z_shift;
-                nodes[idx_new].node_number = nodes[idx_old].node_number + n_nodes_in_plane;
-            }
+    // Levels may be computed before the 2D mesh exists
+    if (mesh.n_nodes_in_plane() == 0)
+        cout << "Extrusion levels computed: " << mesh.n_levels() << " levels..." << endl;
+    else
+        cout << "Extrusion of 2D mesh successful: Created " << mesh.n_nodes() << " nodes and " << mesh.n_prisms() << " elements..." << endl;
 
-            // Create elements
-            for (k = 0; k < n_elems_in_plane; k++)
-            {
-                if (cnt == 1)
-                {
-                    int idx = (cnt - 1)*n_elems_in_plane + k;
+    return true;
+}
 
-                    elements[idx].node4 = elements[idx].node1 + n_nodes_in_plane;
-                    elements[idx].node5 = elements[idx].node2 + n_nodes_in_plane;
-                    elements[idx].node6 = elements[idx].node3 + n_nodes_in_plane;
-                    elements[idx].material_group = mat_group;
-                }
-                else
-                {
-                    int idx_old = (cnt - 2)*n_elems_in_plane + k;
-
-                    prism_element this_element;
-                    this_element.element_number = elements[idx_old].element_number + n_elems_in_plane;
-                    this_element.material_group = mat_group;
-                    this_element.node1 = elements[idx_old].node4;
-                    this_element.node2 = elements[idx_old].node5;
-                    this_element.node3 = elements[idx_old].node6;
-                    this_element.node4 = this_element.node1 + n_nodes_in_plane;
-                    this_element.node5 = this_element.node2 + n_nodes_in_plane;
-                    this_element.node6 = this_element.node3 + n_nodes_in_plane;
-
-                    elements.push_back(this_element);
-                }
-            }
+// Element thicknesses filling length, growing geometrically from the refined ends up to max_thickness
+static void GradedInterval(double length, bool refine_top, bool refine_bottom, const double min_thickness, const double growth, const double max_thickness,
+                           vector<double> &thicknesses)
+{
+    vector<double> top, bottom;
+    int n_ends = (refine_top ? 1 : 0) + (refine_bottom ? 1 : 0);
+    double used = 0, next = (n_ends > 0) ? min_thickness : max_thickness;
+
+    while (n_ends > 0 && next < max_thickness && used + n_ends * next <= length)
+    {
+        if (refine_top)
+            top.push_back(next);
+        if (refine_bottom)
+            bottom.push_back(next);
+        used += n_ends * next;
+        next = min(next * growth, max_thickness);
+    }
 
-            cnt++;
+    // Uniform middle part, a remainder too small for one element stretches the graded ones
+    double rest = length - used;
+    int n_middle = static_cast<int>(round(rest / next));
+    if (rest / max(1, n_middle) > max_thickness)
+        n_middle = static_cast<int>(ceil(rest / max_thickness));
+    if (n_middle == 0 && used > 0)
+    {
+        for (double &thickness : top)
+            thickness *= length / used;
+        for (double &thickness : bottom)
+            thickness *= length / used;
+    }
+    else
+        n_middle = max(1, n_middle);
+
+    thicknesses.insert(thicknesses.end(), top.begin(), top.end());
+    thicknesses.insert(thicknesses.end(), n_middle, rest / max(1, n_middle));
+    thicknesses.insert(thicknesses.end(), bottom.rbegin(), bottom.rend());
+}
+
+bool ExtrudeMeshGraded(extruded_mesh &mesh, const geometry &geom, const vector<layer> &layers, const vector<bhe> &BHEs, int &cnt_mat_groups)
+{
+    size_t i, j;
+    double tolerance = geom.bhe_tolerance;
+    double max_thickness = max(geom.auto_min_thickness, geom.auto_max_aspect * geom.elem_size_box);
+
+    // Layer boundaries, top down from z = 0
+    vector<double> layer_bottoms;
+    double z = 0;
+    for (i = 0; i < layers.size(); i++)
+    {
+        if (layers[i].mat_group < 0 || layers[i].mat_group > UINT16_MAX)
+        {
+            cout << "Error: Material group " << layers[i].mat_group << " of layer " << i << " out of range!" << endl;
+            return false;
+        }
+        if (layers[i].mat_group > cnt_mat_groups)
+            cnt_mat_groups = layers[i].mat_group;
+
+        z -= max(0, layers[i].n_elems) * layers[i].elem_thickness;
+        layer_bottoms.push_back(z);
+    }
+    double z_bottom = z;
+
+    // Fixed levels: top, material boundaries and the BHE ends inside the layers
+    vector<double> fixed_levels(1, 0.0);
+    fixed_levels.insert(fixed_levels.end(), layer_bottoms.begin(), layer_bottoms.end());
+    for (i = 0; i < BHEs.size(); i++)
+        for (double end : { BHEs[i].bhe_top, BHEs[i].bhe_bottom })
+            if (end < -tolerance && end > z_bottom + tolerance)
+                fixed_levels.push_back(end);
+
+    sort(fixed_levels.begin(), fixed_levels.end(), greater<double>());
+    fixed_levels.erase(unique(fixed_levels.begin(), fixed_levels.end(), [&](double a, double b) { return a - b <= tolerance; }), fixed_levels.end());
+
+    mesh.z_levels.assign(1, 0.0);
+    mesh.level_mat_groups.clear();
+
+    // Refined at every fixed level except the model bottom
+    for (i = 0; i + 1 < fixed_levels.size(); i++)
+    {
+        double top = fixed_levels[i], bottom = fixed_levels[i + 1];
+        double middle = 0.5 * (top + bottom);
+        size_t layer_index = 0;
+        while (layer_index + 1 < layers.size() && layer_bottoms[layer_index] > middle)
+            layer_index++;
+
+        vector<double> thicknesses;
+        GradedInterval(top - bottom, true, i + 2 < fixed_levels.size(), geom.auto_min_thickness, geom.auto_growth, max_thickness, thicknesses);
+
+        for (j = 0; j < thicknesses.size(); j++)
+        {
+            // The interval ends exactly on the fixed level
+            mesh.z_levels.push_back(j + 1 == thicknesses.size() ? bottom : mesh.z_levels.back() - thicknesses[j]);
+            mesh.level_mat_groups.push_back(static_cast<uint16_t>(layers[layer_index].mat_group));
         }
     }
 
-    cnt_elems = elements.size();
-    cout << "Extrusion of 2D mesh successful: Created " << nodes.size() << " nodes and " << cnt_elems << " elements..." << endl;
+    if (mesh.n_nodes_in_plane() == 0)
+        cout << "Graded extrusion levels computed: " << mesh.n_levels() << " levels, " << fixed_levels.size() << " fixed..." << endl;
+    else
+        cout << "Graded extrusion of 2D mesh successful: Created " << mesh.n_nodes() << " nodes and " << mesh.n_prisms() << " elements..." << endl;
 
     return true;
 }
 
-bool ComputeBHEelements(const vector<bhe> &BHEs, const vector<node> &nodes, vector<bhe_element> &bhe_elements, const int n_mat_groups, int &n_elems)
+bool ComputeBHEelements(const vector<bhe> &BHEs, extruded_mesh &mesh, const double tolerance, const int n_mat_groups)
 {
     int i, j;
     int n_BHEs = BHEs.size();
-    int n_nodes = nodes.size();
-    int cnt_elem = n_elems - 1;
+    int n_levels = mesh.n_levels();
+    int n_nodes_in_plane = mesh.n_nodes_in_plane();
+    const vector<double> &z_levels = mesh.z_levels;
     int cnt_mat_group = n_mat_groups;
+    bool all_found = true;
+
+    if (n_mat_groups + n_BHEs > UINT16_MAX)
+    {
+        cout << "Error: Too many material groups for " << n_BHEs << " BHEs!" << endl;
+        return false;
+    }
+
+    mesh.bhe_connectivity.clear();
+    mesh.bhe_mat_groups.clear();
+    mesh.first_bhe_group = static_cast<uint16_t>(n_mat_groups + 1);
+
+    // Index the 2D plane once, the extrusion is structured
+    spatial_hash plane_index(tolerance);
+    plane_index.reserve(n_nodes_in_plane);
+    for (j = 0; j < n_nodes_in_plane; j++)
+        plane_index.add(mesh.plane.x[j], mesh.plane.y[j]);
+    plane_index.build();
 
     // Loop over BHEs
     for (i = 0; i < n_BHEs; i++)
@@ -628,97 +1395,54 @@ bool ComputeBHEelements(const vector<bhe> &BHEs, const vector<node> &nodes, vect
         // Increase material group per BHE
         cnt_mat_group++;
 
-        vector<node> bhe_nodes;
-
-        // Loop over nodes
-        for (j = 0; j < n_nodes; j++)
+        int plane_node = plane_index.nearest(BHEs[i].bhe_x, BHEs[i].bhe_y, tolerance);
+        if (plane_node < 0)
         {
-            // Check if node is on BHE and copy to BHE node list
-            if (nodes[j].node_x == BHEs[i].bhe_x && nodes[j].node_y == BHEs[i].bhe_y && nodes[j].node_z <= BHEs[i].bhe_top && nodes[j].node_z >= BHEs[i].bhe_bottom)
-                bhe_nodes.push_back(nodes[j]);
+            cout << "Error: No mesh node within " << tolerance << " of BHE #" << BHEs[i].bhe_number << " at (" << BHEs[i].bhe_x << ", " << BHEs[i].bhe_y << ")!" << endl;
+            all_found = false;
+            continue;
         }
 
-        int n_BHE_nodes = bhe_nodes.size();
-        int n_BHE_elems = n_BHE_nodes - 1;
-
-        // Loop over and create BHE elements
-        for (j = 0; j < n_BHE_elems; j++)
+        // Column levels between BHE top and bottom, top down
+        int first_level = -1, last_level = -1;
+        for (j = 0; j < n_levels; j++)
         {
-            // Increase element counter
-            cnt_elem++;
-
-            bhe_element this_bhe_element;
+            if (z_levels[j] <= BHEs[i].bhe_top + tolerance && z_levels[j] >= BHEs[i].bhe_bottom - tolerance)
+            {
+                if (first_level < 0)
+                    first_level = j;
+                last_level = j;
+            }
+        }
 
-            // Assign element data
-            this_bhe_element.element_number = cnt_elem;
-            this_bhe_element.material_group = cnt_mat_group;
-            this_bhe_element.start_node = bhe_nodes[j].node_number;
-            this_bhe_element.end_node = bhe_nodes[j + 1].node_number;
+        int n_BHE_elems = (first_level < 0) ? 0 : last_level - first_level;
 
-            // Copy to BHE element list
-            bhe_elements.push_back(this_bhe_element);
+        // Loop over and create BHE elements, numbered after the prisms
+        for (j = first_level; j < first_level + n_BHE_elems; j++)
+        {
+            mesh.bhe_connectivity.push_back(mesh.node_index(j, plane_node));
+            mesh.bhe_connectivity.push_back(mesh.node_index(j + 1, plane_node));
+            mesh.bhe_mat_groups.push_back(static_cast<uint16_t>(cnt_mat_group));
         }
 
         cout << "Created " << n_BHE_elems << " elements on BHE #" << i << endl;
     }
 
-    // Write back total number of elements
-    n_elems = cnt_elem;
+    if (!all_found)
+        return false;
 
     cout << "BHE meshing successful..." << endl;
     return true;
 }
 
-bool WriteMesh(const string project_name, const vector<node> &nodes, const vector<prism_element> &prism_elements, const vector<bhe_element> &bhe_elements)
-{
-    // Declarations
-    string line;
-    string mesh_filename = project_name;
-    mesh_filename.append(".bhe.msh");
-    ofstream mesh_file(mesh_filename.c_str());
-
-    int i;
-    int n_nodes = nodes.size();
-    int n_elems = prism_elements.size() + bhe_elements.size();
-
-    // Try to open mesh files
-    if (mesh_file.is_open())
-    {
-        // Write header
-        mesh_file << "#FEM_MSH" << endl;
-        mesh_file << "$PCS_TYPE" << endl;
-        mesh_file << "NO_PCS" << endl;
-        // Write nodes
-        mesh_file << "$NODES" << endl;
-        mesh_file << n_nodes << endl;
-        for (i = 0; i < n_nodes; i++)
-            mesh_file << nodes[i].node_number << " " << nodes[i].node_x << " " << nodes[i].node_y << " " << nodes[i].node_z << endl;
-        //Write elements
-        mesh_file << "$ELEMENTS" << endl;
-        mesh_file << n_elems << endl;
-        for (i = 0; i < prism_elements.size(); i++)
-            mesh_file << prism_elements[i].element_number << " " << prism_elements[i].material_group << " " << prism_elements[i].element_type << " " << prism_elements[i].node1 << " " << prism_elements[i].node2 << " " << prism_elements[i].node3 << " " << prism_elements[i].node4 << " " << prism_elements[i].node5 << " " << prism_elements[i].node6 << endl;
-        for (i = 0; i < bhe_elements.size(); i++)
-            mesh_file << bhe_elements[i].element_number << " " << bhe_elements[i].material_group << " " << bhe_elements[i].element_type << " " << bhe_elements[i].start_node << " " << bhe_elements[i].end_node << endl;
-        mesh_file << "#STOP" << endl;
-
-        mesh_file.close();
-
-        cout << "Write mesh to " << mesh_filename << " successful..." << endl;
-        return true;
-    }
-
-    cout << "Error: Couldn't open mesh file!" << endl;
-    return false;
-}
-
-bool WriteGLI(const string project_name, const geometry &geom, vector<bhe> &BHEs, const vector<additional_point> &add_points)
+bool WriteGLI(const string project_name, const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points, uint64_t *bytes_written)
 {
     // Declarations
     string line;
     string gli_filename = project_name;
     gli_filename.append(".gli");
-    ofstream gli_file(gli_filename.c_str());
+    replacing_ofstream gli_file(gli_filename, false);
+    bool changed;
 
     int i;
     int n_BHEs = BHEs.size();
@@ -842,9 +1566,18 @@ bool WriteGLI(const string project_name, const geometry &geom, vector<bhe> &BHEs
         gli_file << "ply_outflow" << endl;
         gli_file << "#STOP" << endl;
 
-        gli_file.close();
+        if (!gli_file.commit(changed))
+        {
+            cout << "Error: Couldn't write OGS geometry file " << gli_filename << "!" << endl;
+            return false;
+        }
+        if (bytes_written)
+            *bytes_written += gli_file.bytes_written();
 
-        cout << "Write OGS geometry to " << gli_filename << " successful..." << endl;
+        if (changed)
+            cout << "Write OGS geometry to " << gli_filename << " successful..." << endl;
+        else
+            cout << "OGS geometry file " << gli_filename << " is unchanged..." << endl;
         return true;
     }
 
@@ -854,7 +1587,7 @@ bool WriteGLI(const string project_name, const geometry &geom, vector<bhe> &BHEs
 
 vector<string> Tokenize(const string &line)
 {
-    const string delimiter = " ";
+    const string delimiter = " \t\r";
     vector<string> tokens;
 
     // Skip delim at beginning.
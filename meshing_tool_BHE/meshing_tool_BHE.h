@@ -0,0 +1,60 @@
+#ifndef MESHING_TOOL_BHE_H
+#define MESHING_TOOL_BHE_H
+
+#include <vector>
+
+// Input data of the BHE setup tool
+
+struct bhe
+{
+    int bhe_number;
+    double bhe_x;
+    double bhe_y;
+    double bhe_top;
+    double bhe_bottom;
+    double bhe_radius;
+};
+
+struct geometry
+{
+    double width, length, depth;
+    double box_start = -1, box_length = -1, box_width = -1;
+    double elem_size_box, elem_size_corner;
+    double bhe_tolerance = 1.0e-4;
+    // AUTO_LAYERS: graded levels instead of the LAYER elements, disabled if auto_min_thickness <= 0
+    double auto_min_thickness = -1, auto_growth = 1.2, auto_max_aspect = 1;
+    // SIZE_FIELD: GMSH size fields around the BHEs instead of point sizes only, disabled if field_growth <= 0
+    double field_growth = -1, field_max_size = -1;
+};
+
+struct layer
+{
+    int mat_group;
+    int n_elems;
+    double elem_thickness;
+};
+
+struct additional_point
+{
+    double x;
+    double y;
+    double z = 0;
+    double delta = 0;
+};
+
+// Everything an input file describes, read by ReadInputFile or built in memory
+struct model_description
+{
+    geometry geom;
+    std::vector<layer> layers;
+    std::vector<bhe> BHEs;
+    std::vector<additional_point> add_points;
+};
+
+// BHEs are meshed as center node plus hexagon of six nodes at distance alpha * radius
+// Currently fixed with n=6 nodes
+const double bhe_alpha = 6.134;
+const double bhe_hexagon_x[6] = { 0.0, 0.0, 0.866, -0.866, 0.866, -0.866 };
+const double bhe_hexagon_y[6] = { -1.0, 1.0, 0.5, 0.5, -0.5, -0.5 };
+
+#endif //MESHING_TOOL_BHE_H
@@ -0,0 +1,87 @@
+#include "pch.h"
+#include "msh_writer.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "mesh_cache.h"
+#include "text_output.h"
+
+using namespace std;
+
+template <typename Mesh>
+bool WriteMesh(const string project_name, const Mesh &mesh, const int n_threads, uint64_t *bytes_written)
+{
+    // Declarations
+    string mesh_filename = project_name;
+    mesh_filename.append(".bhe.msh");
+    replacing_ofstream mesh_file(mesh_filename);
+    bool changed;
+
+    size_t n_nodes = mesh.n_nodes();
+    size_t n_elems = mesh.n_elements();
+
+    // Try to open mesh files
+    if (mesh_file.is_open())
+    {
+        // Write header
+        text_buffer header;
+        header.put("#FEM_MSH\n");
+        header.put("$PCS_TYPE\n");
+        header.put("NO_PCS\n");
+        header.put("$NODES\n");
+        header.put(n_nodes).put('\n');
+        mesh_file.write(header.data(), header.size());
+
+        // Write nodes
+        WriteChunked(mesh_file, n_nodes, n_threads, [&](size_t first, size_t last, text_buffer &buffer) {
+            for (size_t i = first; i < last; i++)
+            {
+                mesh_node this_node = mesh.node_at(i);
+                buffer.put(this_node.index).put(' ').put(this_node.x).put(' ').put(this_node.y).put(' ').put(this_node.z).put('\n');
+            }
+        });
+
+        //Write elements
+        header.clear();
+        header.put("$ELEMENTS\n");
+        header.put(n_elems).put('\n');
+        mesh_file.write(header.data(), header.size());
+
+        WriteChunked(mesh_file, n_elems, n_threads, [&](size_t first, size_t last, text_buffer &buffer) {
+            for (size_t i = first; i < last; i++)
+            {
+                mesh_element this_element = mesh.element_at(i);
+                buffer.put(this_element.index).put(' ').put(this_element.material_group).put(' ').put(ElementTypeName(this_element.type));
+                for (int k = 0; k < this_element.n_nodes; k++)
+                    buffer.put(' ').put(this_element.nodes[k]);
+                buffer.put('\n');
+            }
+        });
+
+        mesh_file << "#STOP" << endl;
+
+        // Unchanged files are not rewritten
+        if (!mesh_file.commit(changed))
+        {
+            cout << "Error: Couldn't write mesh file " << mesh_filename << "!" << endl;
+            return false;
+        }
+        if (bytes_written)
+            *bytes_written += mesh_file.bytes_written();
+
+        if (changed)
+            cout << "Write mesh to " << mesh_filename << " successful..." << endl;
+        else
+            cout << "Mesh file " << mesh_filename << " is unchanged..." << endl;
+        return true;
+    }
+
+    cout << "Error: Couldn't open mesh file!" << endl;
+    return false;
+}
+
+template bool WriteMesh<extruded_mesh>(const string project_name, const extruded_mesh &mesh, const int n_threads, uint64_t *bytes_written);
+template bool WriteMesh<compact_mesh>(const string project_name, const compact_mesh &mesh, const int n_threads, uint64_t *bytes_written);
@@ -0,0 +1,13 @@
+#ifndef MSH_WRITER_H
+#define MSH_WRITER_H
+
+#include <cstdint>
+#include <string>
+
+// Writes an OGS5 #FEM_MSH mesh file <project_name>.bhe.msh
+// Mesh is extruded_mesh or compact_mesh, entities are formatted on n_threads threads
+// bytes_written gets the bytes that went to disk, 0 for an unchanged file
+template <typename Mesh>
+bool WriteMesh(const std::string project_name, const Mesh &mesh, const int n_threads, uint64_t *bytes_written = nullptr);
+
+#endif //MSH_WRITER_H
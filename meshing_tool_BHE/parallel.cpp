@@ -0,0 +1,33 @@
+#include "pch.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+void ParallelFor(size_t n, int n_threads, const function<void(size_t first, size_t last)> &body)
+{
+    size_t n_workers = min<size_t>(max(1, n_threads), n);
+
+    if (n_workers <= 1)
+    {
+        if (n > 0)
+            body(0, n);
+        return;
+    }
+
+    vector<thread> workers;
+    workers.reserve(n_workers);
+
+    for (size_t k = 0; k < n_workers; k++)
+    {
+        size_t first = n * k / n_workers;
+        size_t last = n * (k + 1) / n_workers;
+        workers.emplace_back(body, first, last);
+    }
+
+    for (thread &worker : workers)
+        worker.join();
+}
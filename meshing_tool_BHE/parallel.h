@@ -0,0 +1,11 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <functional>
+
+// Splits [0, n) into contiguous ranges and runs body(first, last) for each on up to n_threads threads
+// Ranges are fixed by n and n_threads only, so results written per index are deterministic
+void ParallelFor(size_t n, int n_threads, const std::function<void(size_t first, size_t last)> &body);
+
+#endif //PARALLEL_H
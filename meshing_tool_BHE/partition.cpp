@@ -0,0 +1,385 @@
+#include "pch.h"
+#include "partition.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include "mesh_cache.h"
+#include "parallel.h"
+#include "text_output.h"
+
+using namespace std;
+
+// Buffered text is flushed to the file beyond this size
+static const size_t flush_size = 1 << 20;
+
+int mesh_partitioning::element_partition(const extruded_mesh &mesh, size_t element) const
+{
+    size_t n_prism_elements = mesh.n_prisms();
+    if (element >= n_prism_elements)
+    {
+        size_t line = element - n_prism_elements, level, column;
+        mesh.node_position(min(mesh.bhe_connectivity[2 * line], mesh.bhe_connectivity[2 * line + 1]), level, column);
+        return element_level_parts[level] * n_plane_parts + plane_node_parts[column];
+    }
+
+    size_t level, plane_element;
+    mesh.prism_position(element, level, plane_element);
+    return element_level_parts[level] * n_plane_parts + plane_element_parts[plane_element];
+}
+
+int mesh_partitioning::node_partition(const extruded_mesh &mesh, size_t node) const
+{
+    // The lowest partition of the prisms above and below the node
+    size_t level, plane_node;
+    mesh.node_position(node, level, plane_node);
+    return element_level_parts[max<size_t>(level, 1) - 1] * n_plane_parts + plane_node_parts[plane_node];
+}
+
+// Recursive coordinate bisection: splits the plane elements [first, last) across the
+// longer extent of their centroids into parts proportional to the part counts
+static void Bisect(vector<uint32_t>::iterator first, vector<uint32_t>::iterator last, const vector<double> &cx, const vector<double> &cy,
+                   int first_part, int n_parts, vector<int> &parts)
+{
+    if (n_parts == 1 || last - first <= 1)
+    {
+        for (auto it = first; it != last; ++it)
+            parts[*it] = first_part;
+        return;
+    }
+
+    double x_min = cx[*first], x_max = x_min, y_min = cy[*first], y_max = y_min;
+    for (auto it = first; it != last; ++it)
+    {
+        x_min = min(x_min, cx[*it]);
+        x_max = max(x_max, cx[*it]);
+        y_min = min(y_min, cy[*it]);
+        y_max = max(y_max, cy[*it]);
+    }
+    const vector<double> &c = (x_max - x_min >= y_max - y_min) ? cx : cy;
+
+    int n_left = n_parts / 2;
+    auto middle = first + (last - first) * n_left / n_parts;
+    // Ties are broken by index so the split is deterministic
+    nth_element(first, middle, last, [&](uint32_t a, uint32_t b) { return c[a] < c[b] || (c[a] == c[b] && a < b); });
+
+    Bisect(first, middle, cx, cy, first_part, n_left, parts);
+    Bisect(middle, last, cx, cy, first_part + n_left, n_parts - n_left, parts);
+}
+
+bool PartitionMesh(const extruded_mesh &mesh, int n_plane_parts, int n_level_parts, mesh_partitioning &partitioning)
+{
+    size_t n_plane_nodes = mesh.n_nodes_in_plane();
+    size_t n_plane_elems = mesh.n_elems_in_plane();
+    size_t n_element_levels = mesh.level_mat_groups.size();
+
+    if (n_plane_elems == 0 || n_element_levels == 0)
+    {
+        cout << "Error: Can't partition a mesh without prisms!" << endl;
+        return false;
+    }
+
+    partitioning = mesh_partitioning();
+    partitioning.n_plane_parts = static_cast<int>(min<size_t>(max(1, n_plane_parts), n_plane_elems));
+
+    // Plane: bisection of the element centroids
+    vector<double> cx(n_plane_elems, 0), cy(n_plane_elems, 0);
+    vector<uint32_t> order(n_plane_elems);
+    for (size_t e = 0; e < n_plane_elems; e++)
+    {
+        mesh_element face = mesh.plane.element_at(e);
+        for (int k = 0; k < face.n_nodes; k++)
+        {
+            cx[e] += mesh.plane.x[face.nodes[k]];
+            cy[e] += mesh.plane.y[face.nodes[k]];
+        }
+        cx[e] /= face.n_nodes;
+        cy[e] /= face.n_nodes;
+        order[e] = static_cast<uint32_t>(e);
+    }
+    partitioning.plane_element_parts.assign(n_plane_elems, 0);
+    Bisect(order.begin(), order.end(), cx, cy, 0, partitioning.n_plane_parts, partitioning.plane_element_parts);
+
+    partitioning.plane_node_parts.assign(n_plane_nodes, partitioning.n_plane_parts);
+    for (size_t e = 0; e < n_plane_elems; e++)
+    {
+        mesh_element face = mesh.plane.element_at(e);
+        for (int k = 0; k < face.n_nodes; k++)
+            partitioning.plane_node_parts[face.nodes[k]] = min(partitioning.plane_node_parts[face.nodes[k]], partitioning.plane_element_parts[e]);
+    }
+    // Nodes outside all plane elements
+    for (int &part : partitioning.plane_node_parts)
+        if (part == partitioning.n_plane_parts)
+            part = 0;
+
+    // Levels: cuts inside the level range of a BHE are not allowed,
+    // consecutive line elements of the same column belong to one BHE
+    vector<char> forbidden(n_element_levels + 1, 0);
+    size_t n_bhe_lines = mesh.n_bhe_elements();
+    size_t bhe_first = 0, bhe_last = 0, bhe_column = 0;
+    for (size_t line = 0; line <= n_bhe_lines; line++)
+    {
+        size_t level = 0, column = 0;
+        if (line < n_bhe_lines)
+        {
+            mesh.node_position(min(mesh.bhe_connectivity[2 * line], mesh.bhe_connectivity[2 * line + 1]), level, column);
+        }
+
+        bool continues = line > 0 && line < n_bhe_lines && column == bhe_column && level == bhe_last + 1;
+        if (line > 0 && !continues)
+            for (size_t l = bhe_first + 1; l <= bhe_last; l++)
+                forbidden[l] = 1;
+        if (!continues)
+            bhe_first = level;
+        bhe_last = level;
+        bhe_column = column;
+    }
+
+    int requested_level_parts = static_cast<int>(min<size_t>(max(1, n_level_parts), n_element_levels));
+    partitioning.level_cuts.push_back(0);
+    for (int k = 1; k < requested_level_parts; k++)
+    {
+        // Nearest allowed level to the even split, above the previous cut
+        size_t target = n_element_levels * k / requested_level_parts;
+        size_t previous = partitioning.level_cuts.back();
+        size_t best = 0;
+        for (size_t distance = 0; best == 0 && distance < n_element_levels; distance++)
+        {
+            if (target >= distance && target - distance > previous && !forbidden[target - distance])
+                best = target - distance;
+            else if (target + distance < n_element_levels && target + distance > previous && !forbidden[target + distance])
+                best = target + distance;
+        }
+        if (best > 0)
+            partitioning.level_cuts.push_back(best);
+    }
+    partitioning.level_cuts.push_back(n_element_levels);
+    partitioning.n_level_parts = static_cast<int>(partitioning.level_cuts.size()) - 1;
+
+    if (partitioning.n_level_parts < requested_level_parts)
+        cout << "Warning: BHEs allow only " << partitioning.n_level_parts << " of " << requested_level_parts << " vertical partitions!" << endl;
+
+    partitioning.element_level_parts.resize(n_element_levels);
+    for (int k = 0; k < partitioning.n_level_parts; k++)
+        fill(partitioning.element_level_parts.begin() + partitioning.level_cuts[k], partitioning.element_level_parts.begin() + partitioning.level_cuts[k + 1], k);
+
+    cout << "Partitioning successful: " << partitioning.n_partitions() << " partitions (" << partitioning.n_plane_parts << " in plane x "
+         << partitioning.n_level_parts << " vertical)..." << endl;
+    return true;
+}
+
+// Global entities of one partition, owned/inner first, ghosts after, each in global order
+struct partition_entities
+{
+    vector<uint32_t> nodes;
+    size_t n_owned_nodes = 0;
+    vector<size_t> elements;
+    size_t n_inner_elements = 0;
+};
+
+static void CollectPartition(const extruded_mesh &mesh, const mesh_partitioning &partitioning, int partition, partition_entities &entities)
+{
+    int level_part = partition / partitioning.n_plane_parts;
+    int plane_part = partition - level_part * partitioning.n_plane_parts;
+    size_t n_plane_nodes = mesh.n_nodes_in_plane();
+    size_t n_plane_elems = mesh.n_elems_in_plane();
+    size_t n_element_levels = mesh.level_mat_groups.size();
+    size_t n_prism_elements = mesh.n_prisms();
+
+    // Element levels of the partition and node levels it owns (the top level belongs to the part above)
+    size_t first_level = partitioning.level_cuts[level_part], last_level = partitioning.level_cuts[level_part + 1];
+    size_t first_node_level = level_part == 0 ? 0 : first_level + 1;
+
+    // Plane elements of the part, and the plane elements with a node owned by the part (ghost candidates): of the part and of other parts
+    vector<uint32_t> inner_plane, owning_plane, touching_plane;
+    for (size_t e = 0; e < n_plane_elems; e++)
+    {
+        mesh_element face = mesh.plane.element_at(e);
+        bool inner = partitioning.plane_element_parts[e] == plane_part;
+        if (inner)
+            inner_plane.push_back(static_cast<uint32_t>(e));
+        if (any_of(face.nodes, face.nodes + face.n_nodes, [&](uint32_t node) { return partitioning.plane_node_parts[node] == plane_part; }))
+            (inner ? owning_plane : touching_plane).push_back(static_cast<uint32_t>(e));
+    }
+
+    entities = partition_entities();
+    for (size_t level = first_node_level; level <= last_level; level++)
+        for (size_t n = 0; n < n_plane_nodes; n++)
+            if (partitioning.plane_node_parts[n] == plane_part)
+                entities.nodes.push_back(mesh.node_index(level, n));
+    entities.n_owned_nodes = entities.nodes.size();
+    // Column-major numbering interleaves the levels
+    if (mesh.column_major)
+        sort(entities.nodes.begin(), entities.nodes.end());
+
+    // Inner elements
+    for (size_t level = first_level; level < last_level; level++)
+        for (uint32_t e : inner_plane)
+            entities.elements.push_back(mesh.prism_index(level, e));
+    for (size_t line = 0; line < mesh.n_bhe_elements(); line++)
+        if (partitioning.element_partition(mesh, n_prism_elements + line) == partition)
+            entities.elements.push_back(n_prism_elements + line);
+    entities.n_inner_elements = entities.elements.size();
+    if (mesh.column_major)
+        sort(entities.elements.begin(), entities.elements.end());
+
+    // Ghost layer: prisms and lines of other partitions sharing a node owned by the partition
+    auto owned = [&](uint32_t node) { return partitioning.node_partition(mesh, node) == partition; };
+    auto owned_level = [&](size_t level) { return level >= first_node_level && level <= last_level; };
+    vector<size_t> ghosts;
+    // Below the partition (its bottom nodes) also the prisms over its own plane elements
+    vector<uint32_t> around_plane(owning_plane.size() + touching_plane.size());
+    merge(owning_plane.begin(), owning_plane.end(), touching_plane.begin(), touching_plane.end(), around_plane.begin());
+    for (size_t level = first_level > 0 ? first_level - 1 : 0; level < n_element_levels && level <= last_level; level++)
+    {
+        if (!owned_level(level) && !owned_level(level + 1))
+            continue;
+        bool inner_level = level >= first_level && level < last_level;
+        for (uint32_t e : inner_level ? touching_plane : around_plane)
+            ghosts.push_back(mesh.prism_index(level, e));
+    }
+    for (size_t line = 0; line < mesh.n_bhe_elements(); line++)
+        if (partitioning.element_partition(mesh, n_prism_elements + line) != partition &&
+            (owned(mesh.bhe_connectivity[2 * line]) || owned(mesh.bhe_connectivity[2 * line + 1])))
+            ghosts.push_back(n_prism_elements + line);
+    if (mesh.column_major)
+        sort(ghosts.begin(), ghosts.end());
+    entities.elements.insert(entities.elements.end(), ghosts.begin(), ghosts.end());
+
+    // Ghost nodes: the other nodes of all elements
+    vector<uint32_t> ghost_nodes;
+    for (size_t element : entities.elements)
+    {
+        mesh_element this_element = mesh.element_at(element);
+        for (int k = 0; k < this_element.n_nodes; k++)
+            if (!owned(this_element.nodes[k]))
+                ghost_nodes.push_back(this_element.nodes[k]);
+    }
+    sort(ghost_nodes.begin(), ghost_nodes.end());
+    ghost_nodes.erase(unique(ghost_nodes.begin(), ghost_nodes.end()), ghost_nodes.end());
+    entities.nodes.insert(entities.nodes.end(), ghost_nodes.begin(), ghost_nodes.end());
+}
+
+static void Flush(ostream &out, text_buffer &buffer, bool force)
+{
+    if (force || buffer.size() >= flush_size)
+    {
+        out.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+}
+
+static bool WritePartitionFiles(const string project_name, const extruded_mesh &mesh, const mesh_partitioning &partitioning, int partition,
+                                const partition_entities &entities, uint64_t &bytes_written)
+{
+    string base_name = project_name + ".part" + to_string(partition);
+    string nodes_filename = base_name + ".nodes", elements_filename = base_name + ".elements";
+    bool changed;
+    text_buffer buffer;
+
+    unordered_map<uint32_t, uint32_t> global_to_local;
+    global_to_local.reserve(entities.nodes.size());
+    for (size_t i = 0; i < entities.nodes.size(); i++)
+        global_to_local[entities.nodes[i]] = static_cast<uint32_t>(i);
+
+    // Nodes: local global owner x y z
+    replacing_ofstream nodes_file(nodes_filename);
+    if (!nodes_file.is_open())
+        return false;
+    buffer.put("#PARTITION\n").put(partition).put(' ').put(partitioning.n_partitions()).put('\n');
+    buffer.put("$NODES\n").put(entities.n_owned_nodes).put(' ').put(entities.nodes.size() - entities.n_owned_nodes).put('\n');
+    for (size_t i = 0; i < entities.nodes.size(); i++)
+    {
+        mesh_node this_node = mesh.node_at(entities.nodes[i]);
+        int owner = i < entities.n_owned_nodes ? partition : partitioning.node_partition(mesh, this_node.index);
+        buffer.put(i).put(' ').put(this_node.index).put(' ').put(owner).put(' ');
+        buffer.put(this_node.x).put(' ').put(this_node.y).put(' ').put(this_node.z).put('\n');
+        Flush(nodes_file, buffer, false);
+    }
+    buffer.put("#STOP\n");
+    Flush(nodes_file, buffer, true);
+    if (!nodes_file.commit(changed))
+        return false;
+    bytes_written += nodes_file.bytes_written();
+
+    // Elements: local global owner material type local nodes
+    replacing_ofstream elements_file(elements_filename);
+    if (!elements_file.is_open())
+        return false;
+    buffer.put("#PARTITION\n").put(partition).put(' ').put(partitioning.n_partitions()).put('\n');
+    buffer.put("$ELEMENTS\n").put(entities.n_inner_elements).put(' ').put(entities.elements.size() - entities.n_inner_elements).put('\n');
+    for (size_t i = 0; i < entities.elements.size(); i++)
+    {
+        mesh_element this_element = mesh.element_at(entities.elements[i]);
+        int owner = i < entities.n_inner_elements ? partition : partitioning.element_partition(mesh, this_element.index);
+        buffer.put(i).put(' ').put(this_element.index).put(' ').put(owner).put(' ');
+        buffer.put(this_element.material_group).put(' ').put(ElementTypeName(this_element.type));
+        for (int k = 0; k < this_element.n_nodes; k++)
+            buffer.put(' ').put(global_to_local[this_element.nodes[k]]);
+        buffer.put('\n');
+        Flush(elements_file, buffer, false);
+    }
+    buffer.put("#STOP\n");
+    Flush(elements_file, buffer, true);
+    if (!elements_file.commit(changed))
+        return false;
+    bytes_written += elements_file.bytes_written();
+    return true;
+}
+
+bool WritePartitions(const string project_name, const extruded_mesh &mesh, const mesh_partitioning &partitioning, const int n_threads, uint64_t *bytes_written)
+{
+    int n_partitions = partitioning.n_partitions();
+    vector<char> written(n_partitions, 0);
+    vector<uint64_t> partition_bytes(n_partitions, 0);
+    vector<size_t> counts(4 * n_partitions, 0);
+
+    // Partitions are independent, each worker collects and writes its range
+    ParallelFor(n_partitions, n_threads, [&](size_t first, size_t last) {
+        partition_entities entities;
+        for (size_t p = first; p < last; p++)
+        {
+            CollectPartition(mesh, partitioning, static_cast<int>(p), entities);
+            written[p] = WritePartitionFiles(project_name, mesh, partitioning, static_cast<int>(p), entities, partition_bytes[p]);
+            counts[4 * p] = entities.n_owned_nodes;
+            counts[4 * p + 1] = entities.nodes.size() - entities.n_owned_nodes;
+            counts[4 * p + 2] = entities.n_inner_elements;
+            counts[4 * p + 3] = entities.elements.size() - entities.n_inner_elements;
+        }
+    });
+
+    for (int p = 0; p < n_partitions; p++)
+        if (!written[p])
+        {
+            cout << "Error: Couldn't write partition " << p << " of " << project_name << "!" << endl;
+            return false;
+        }
+
+    // Summary: partition owned_nodes ghost_nodes inner_elements ghost_elements
+    string summary_filename = project_name + ".partitions";
+    ofstream summary_file(summary_filename.c_str());
+    summary_file << "#PARTITIONS" << endl;
+    summary_file << n_partitions << " " << partitioning.n_plane_parts << " " << partitioning.n_level_parts << endl;
+    for (int p = 0; p < n_partitions; p++)
+        summary_file << p << " " << counts[4 * p] << " " << counts[4 * p + 1] << " " << counts[4 * p + 2] << " " << counts[4 * p + 3] << endl;
+    summary_file << "#STOP" << endl;
+    uint64_t summary_bytes = summary_file.tellp();
+    summary_file.close();
+    if (summary_file.fail())
+    {
+        cout << "Error: Couldn't write partition summary " << summary_filename << "!" << endl;
+        return false;
+    }
+
+    if (bytes_written)
+    {
+        *bytes_written += summary_bytes;
+        for (int p = 0; p < n_partitions; p++)
+            *bytes_written += partition_bytes[p];
+    }
+
+    cout << "Write " << n_partitions << " partitions to " << project_name << ".part*.nodes/.elements successful..." << endl;
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "extruded_mesh.h"
+
+// Domain decomposition of an extruded mesh into n_plane_parts x n_level_parts partitions
+// The plane is split by recursive coordinate bisection of the element centroids, the
+// element levels into contiguous ranges. Partition = level part * n_plane_parts + plane part.
+// A node is owned by the lowest partition of the prisms containing it,
+// a BHE line element by the partition owning its column and level range.
+struct mesh_partitioning
+{
+    int n_plane_parts = 1, n_level_parts = 1;
+    std::vector<int> plane_element_parts;   // one per plane element
+    std::vector<int> plane_node_parts;      // one per plane node, lowest part of its elements
+    std::vector<size_t> level_cuts;         // n_level_parts + 1 element levels, first 0, last n_element_levels
+    std::vector<int> element_level_parts;   // one per element level
+
+    int n_partitions() const { return n_plane_parts * n_level_parts; }
+
+    int element_partition(const extruded_mesh &mesh, size_t element) const;
+    int node_partition(const extruded_mesh &mesh, size_t node) const;
+};
+
+// Computes the partitioning, level cuts are moved so that no BHE is split vertically,
+// fewer level parts than requested remain if the BHEs leave no room for a cut
+bool PartitionMesh(const extruded_mesh &mesh, int n_plane_parts, int n_level_parts, mesh_partitioning &partitioning);
+
+// Writes <project_name>.part<p>.nodes and .elements per partition and the summary <project_name>.partitions
+// Each partition holds its owned nodes and elements followed by one ghost layer: the elements of
+// other partitions sharing a node owned by it, and their nodes. Entities carry local index,
+// global index (the global-to-local map) and owning partition. Partitions are written on n_threads threads.
+// bytes_written gets the bytes that went to disk, unchanged partition files count 0
+bool WritePartitions(const std::string project_name, const extruded_mesh &mesh, const mesh_partitioning &partitioning, const int n_threads,
+                     uint64_t *bytes_written = nullptr);
+
+#endif //PARTITION_H
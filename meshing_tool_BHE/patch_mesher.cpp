@@ -0,0 +1,331 @@
+#include "pch.h"
+#include "patch_mesher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+
+#include "plane_mesher.h"
+
+using namespace std;
+
+// Full rectangular grid of BHEs, cell (i, j) is centered at its BHE (x0 + i * dx, y0 + j * dy)
+struct bhe_array
+{
+    size_t nx = 0, ny = 0;
+    double x0 = 0, y0 = 0, dx = 0, dy = 0;
+    double radius = 0;
+    double outer_size = 0;      // element size of the region around the array (box or domain)
+};
+
+// Side nodes of the cell mesh sorted along the side, corners counter-clockwise from the lower left
+struct cell_sides
+{
+    uint32_t corners[4];
+    vector<uint32_t> bottom, top, left, right;
+};
+
+// Distinct coordinates within tolerance, returns false unless there are several equally spaced ones
+static bool GridLines(vector<double> values, const double tolerance, size_t &n, double &first, double &spacing)
+{
+    sort(values.begin(), values.end());
+    vector<double> lines(1, values[0]);
+    for (double value : values)
+        if (value - lines.back() > tolerance)
+            lines.push_back(value);
+
+    n = lines.size();
+    first = lines.front();
+    spacing = (n > 1) ? (lines.back() - lines.front()) / (n - 1) : 0;
+    for (size_t k = 0; k < n; k++)
+        if (fabs(lines[k] - (first + k * spacing)) > tolerance)
+            return false;
+    return n > 1;
+}
+
+static bool FindArray(const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points, bhe_array &array)
+{
+    double tolerance = 0.5 * geom.bhe_tolerance;
+
+    if (BHEs.size() < 4)
+    {
+        cout << "Warning: Patch meshing needs at least 2 x 2 BHEs, meshing the whole plane!" << endl;
+        return false;
+    }
+
+    vector<double> xs(BHEs.size()), ys(BHEs.size());
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        xs[i] = BHEs[i].bhe_x;
+        ys[i] = BHEs[i].bhe_y;
+    }
+    bool regular = GridLines(xs, tolerance, array.nx, array.x0, array.dx) && GridLines(ys, tolerance, array.ny, array.y0, array.dy) &&
+                   array.nx * array.ny == BHEs.size();
+
+    // Every grid position holds one BHE of the same radius
+    array.radius = BHEs[0].bhe_radius;
+    vector<char> occupied(array.nx * array.ny, 0);
+    for (size_t n = 0; n < BHEs.size() && regular; n++)
+    {
+        size_t i = static_cast<size_t>(max(0.0, floor((BHEs[n].bhe_x - array.x0) / array.dx + 0.5)));
+        size_t j = static_cast<size_t>(max(0.0, floor((BHEs[n].bhe_y - array.y0) / array.dy + 0.5)));
+        regular = i < array.nx && j < array.ny && !occupied[j * array.nx + i] &&
+                  fabs(BHEs[n].bhe_x - (array.x0 + i * array.dx)) <= tolerance && fabs(BHEs[n].bhe_y - (array.y0 + j * array.dy)) <= tolerance &&
+                  fabs(BHEs[n].bhe_radius - array.radius) <= 1.0e-9 * array.radius;
+        if (regular)
+            occupied[j * array.nx + i] = 1;
+    }
+    if (!regular)
+    {
+        cout << "Warning: BHEs don't form a regular grid of equal BHEs, meshing the whole plane!" << endl;
+        return false;
+    }
+
+    double delta = bhe_alpha * array.radius;
+    if (min(array.dx, array.dy) < 4 * delta)
+    {
+        cout << "Warning: BHE spacing too small for patch meshing, meshing the whole plane!" << endl;
+        return false;
+    }
+
+    // The array keeps one element size away from the model boundary, the box lines and the additional points
+    double left = array.x0 - 0.5 * array.dx - delta, right = array.x0 + (array.nx - 0.5) * array.dx + delta;
+    double bottom = array.y0 - 0.5 * array.dy - delta, top = array.y0 + (array.ny - 0.5) * array.dy + delta;
+    bool separate = left >= -geom.width / 2.0 && right <= geom.width / 2.0 && bottom >= 0 && top <= geom.length;
+    bool in_box = false;
+
+    if (!(geom.box_length == -1 || geom.box_start == -1 || geom.box_width == -1))
+    {
+        double box_left = -geom.box_width / 2.0, box_right = geom.box_width / 2.0;
+        double box_bottom = geom.box_start, box_top = geom.box_start + geom.box_length;
+        in_box = left >= box_left && right <= box_right && bottom >= box_bottom && top <= box_top;
+        bool apart = left >= box_right || right <= box_left || bottom >= box_top || top <= box_bottom;
+        separate = separate && (in_box || apart);
+    }
+
+    for (size_t i = 0; i < add_points.size(); i++)
+        if (add_points[i].x > left && add_points[i].x < right && add_points[i].y > bottom && add_points[i].y < top)
+            separate = false;
+
+    if (!separate)
+    {
+        cout << "Warning: BHE array too close to the model boundary, box or additional points for patch meshing, meshing the whole plane!" << endl;
+        return false;
+    }
+
+    array.outer_size = in_box ? geom.elem_size_box : geom.elem_size_corner;
+    return true;
+}
+
+// Sorts the boundary nodes of the cell mesh by side, false if opposite sides don't match
+static bool CellSides(const compact_mesh &cell, const double dx, const double dy, cell_sides &sides)
+{
+    double eps = 1.0e-9 * max(dx, dy);
+    double match = 1.0e-6 * min(dx, dy);
+    const uint32_t unset = numeric_limits<uint32_t>::max();
+    fill(sides.corners, sides.corners + 4, unset);
+
+    for (uint32_t n = 0; n < cell.n_nodes(); n++)
+    {
+        bool on_left = fabs(cell.x[n] + 0.5 * dx) <= eps, on_right = fabs(cell.x[n] - 0.5 * dx) <= eps;
+        bool on_bottom = fabs(cell.y[n]) <= eps, on_top = fabs(cell.y[n] - dy) <= eps;
+
+        if ((on_left || on_right) && (on_bottom || on_top))
+            sides.corners[on_bottom ? (on_left ? 0 : 1) : (on_right ? 2 : 3)] = n;
+        else if (on_bottom)
+            sides.bottom.push_back(n);
+        else if (on_top)
+            sides.top.push_back(n);
+        else if (on_left)
+            sides.left.push_back(n);
+        else if (on_right)
+            sides.right.push_back(n);
+    }
+
+    auto by_x = [&](uint32_t a, uint32_t b) { return cell.x[a] < cell.x[b]; };
+    auto by_y = [&](uint32_t a, uint32_t b) { return cell.y[a] < cell.y[b]; };
+    sort(sides.bottom.begin(), sides.bottom.end(), by_x);
+    sort(sides.top.begin(), sides.top.end(), by_x);
+    sort(sides.left.begin(), sides.left.end(), by_y);
+    sort(sides.right.begin(), sides.right.end(), by_y);
+
+    if (find(sides.corners, sides.corners + 4, unset) != sides.corners + 4 || sides.bottom.size() != sides.top.size() || sides.left.size() != sides.right.size())
+        return false;
+    for (size_t k = 0; k < sides.bottom.size(); k++)
+        if (fabs(cell.x[sides.bottom[k]] - cell.x[sides.top[k]]) > match)
+            return false;
+    for (size_t k = 0; k < sides.left.size(); k++)
+        if (fabs(cell.y[sides.left[k]] - cell.y[sides.right[k]]) > match)
+            return false;
+    return true;
+}
+
+bool MeshPlanePatched(const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points, compact_mesh &plane)
+{
+    bhe_array array;
+    if (!FindArray(geom, BHEs, add_points, array))
+        return MeshPlane(geom, BHEs, add_points, plane);
+
+    size_t nx = array.nx, ny = array.ny;
+    double delta = bhe_alpha * array.radius;
+
+    // Cell corners grade up to the size around the array, or to the SIZE_FIELD size at their distance from the BHE,
+    // keeping at least two elements per cell side
+    double corner_size = array.outer_size;
+    if (geom.field_growth > 0)
+    {
+        double corner_distance = 0.5 * hypot(array.dx, array.dy);
+        corner_size = min(corner_size, min(geom.field_max_size, delta + geom.field_growth * (corner_distance - delta)));
+    }
+    corner_size = max(delta, min(corner_size, 0.5 * min(array.dx, array.dy)));
+
+    // One cell as a model of its own: BHE in the center, graded to the corner size at the cell corners.
+    // Refinement may split the sides of a coarse cell differently, the corner size is then halved down to the BHE size.
+    geometry cell_geom = geom;
+    cell_geom.width = array.dx;
+    cell_geom.length = array.dy;
+    cell_geom.box_start = cell_geom.box_length = cell_geom.box_width = -1;
+    bhe cell_BHE = BHEs[0];
+    cell_BHE.bhe_x = 0;
+    cell_BHE.bhe_y = 0.5 * array.dy;
+
+    compact_mesh cell;
+    cell_sides sides;
+    for (;;)
+    {
+        cell_geom.elem_size_corner = corner_size;
+        if (!MeshPlane(cell_geom, vector<bhe>(1, cell_BHE), vector<additional_point>(), cell))
+            return false;
+        sides = cell_sides();
+        if (CellSides(cell, array.dx, array.dy, sides))
+            break;
+        if (corner_size <= delta)
+        {
+            cout << "Warning: Cell mesh of the BHE array is not periodic, meshing the whole plane!" << endl;
+            return MeshPlane(geom, BHEs, add_points, plane);
+        }
+        corner_size = max(delta, 0.5 * corner_size);
+    }
+    size_t nb = sides.bottom.size(), nl = sides.left.size();
+
+    auto cell_x = [&](uint32_t node, size_t i) { return array.x0 + i * array.dx + cell.x[node]; };
+    auto cell_y = [&](uint32_t node, size_t j) { return array.y0 + j * array.dy - 0.5 * array.dy + cell.y[node]; };
+
+    // Merged nodes on the grid lines: corners (gi, gj), horizontal sides (i, gj, k) and vertical sides (gi, j, k)
+    const uint32_t unset = numeric_limits<uint32_t>::max();
+    vector<uint32_t> corner_nodes((nx + 1) * (ny + 1), unset);
+    vector<uint32_t> horizontal_nodes(nx * (ny + 1) * nb, unset), vertical_nodes((nx + 1) * ny * nl, unset);
+    auto corner = [&](size_t gi, size_t gj) -> uint32_t & { return corner_nodes[gj * (nx + 1) + gi]; };
+    auto horizontal = [&](size_t i, size_t gj, size_t k) -> uint32_t & { return horizontal_nodes[(gj * nx + i) * nb + k]; };
+    auto vertical = [&](size_t gi, size_t j, size_t k) -> uint32_t & { return vertical_nodes[(j * (nx + 1) + gi) * nl + k]; };
+
+    // Hole of the margin mesh along the outer grid lines, counter-clockwise
+    plane_hole hole;
+    hole.size = corner_size;
+    vector<uint32_t *> hole_slots;
+    auto add_hole_node = [&](uint32_t &slot, double x, double y) {
+        hole_slots.push_back(&slot);
+        hole.x.push_back(x);
+        hole.y.push_back(y);
+    };
+    for (size_t i = 0; i < nx; i++)
+    {
+        add_hole_node(corner(i, 0), cell_x(sides.corners[0], i), cell_y(sides.corners[0], 0));
+        for (size_t k = 0; k < nb; k++)
+            add_hole_node(horizontal(i, 0, k), cell_x(sides.bottom[k], i), cell_y(sides.bottom[k], 0));
+    }
+    for (size_t j = 0; j < ny; j++)
+    {
+        add_hole_node(corner(nx, j), cell_x(sides.corners[1], nx - 1), cell_y(sides.corners[1], j));
+        for (size_t k = 0; k < nl; k++)
+            add_hole_node(vertical(nx, j, k), cell_x(sides.right[k], nx - 1), cell_y(sides.right[k], j));
+    }
+    for (size_t i = nx; i-- > 0;)
+    {
+        add_hole_node(corner(i + 1, ny), cell_x(sides.corners[2], i), cell_y(sides.corners[2], ny - 1));
+        for (size_t k = nb; k-- > 0;)
+            add_hole_node(horizontal(i, ny, k), cell_x(sides.top[k], i), cell_y(sides.top[k], ny - 1));
+    }
+    for (size_t j = ny; j-- > 0;)
+    {
+        add_hole_node(corner(0, j + 1), cell_x(sides.corners[3], 0), cell_y(sides.corners[3], j));
+        for (size_t k = nl; k-- > 0;)
+            add_hole_node(vertical(0, j, k), cell_x(sides.left[k], 0), cell_y(sides.left[k], j));
+    }
+
+    // Margin, its first nodes are the hole nodes
+    if (!MeshPlane(geom, vector<bhe>(), add_points, plane, &hole))
+    {
+        cout << "Warning: Couldn't mesh the margin of the BHE array, meshing the whole plane!" << endl;
+        return MeshPlane(geom, BHEs, add_points, plane);
+    }
+    size_t n_margin_elements = plane.n_elements();
+    for (size_t k = 0; k < hole_slots.size(); k++)
+        *hole_slots[k] = static_cast<uint32_t>(k);
+
+    // Side nodes of the cell by slot: corners, bottom, top, left, right
+    vector<int> roles(cell.n_nodes(), -1);
+    for (int c = 0; c < 4; c++)
+        roles[sides.corners[c]] = c;
+    for (size_t k = 0; k < nb; k++)
+    {
+        roles[sides.bottom[k]] = static_cast<int>(4 + k);
+        roles[sides.top[k]] = static_cast<int>(4 + nb + k);
+    }
+    for (size_t k = 0; k < nl; k++)
+    {
+        roles[sides.left[k]] = static_cast<int>(4 + 2 * nb + k);
+        roles[sides.right[k]] = static_cast<int>(4 + 2 * nb + nl + k);
+    }
+
+    // Translated copies of the cell, side nodes are created by the first cell (or the margin) and reused
+    size_t n_cells = nx * ny;
+    plane.reserve(plane.n_nodes() + n_cells * cell.n_nodes(), plane.n_elements() + n_cells * cell.n_elements(),
+                  plane.n_connectivity() + n_cells * cell.n_connectivity());
+    vector<uint32_t> local(cell.n_nodes());
+    vector<uint32_t *> slots(4 + 2 * nb + 2 * nl);
+    for (size_t j = 0; j < ny; j++)
+        for (size_t i = 0; i < nx; i++)
+        {
+            slots[0] = &corner(i, j);
+            slots[1] = &corner(i + 1, j);
+            slots[2] = &corner(i + 1, j + 1);
+            slots[3] = &corner(i, j + 1);
+            for (size_t k = 0; k < nb; k++)
+            {
+                slots[4 + k] = &horizontal(i, j, k);
+                slots[4 + nb + k] = &horizontal(i, j + 1, k);
+            }
+            for (size_t k = 0; k < nl; k++)
+            {
+                slots[4 + 2 * nb + k] = &vertical(i, j, k);
+                slots[4 + 2 * nb + nl + k] = &vertical(i + 1, j, k);
+            }
+
+            for (uint32_t n = 0; n < cell.n_nodes(); n++)
+            {
+                uint32_t *slot = (roles[n] < 0) ? nullptr : slots[roles[n]];
+                if (slot != nullptr && *slot != unset)
+                {
+                    local[n] = *slot;
+                    continue;
+                }
+                local[n] = plane.add_node(cell_x(n, i), cell_y(n, j), 0.0);
+                if (slot != nullptr)
+                    *slot = local[n];
+            }
+
+            for (size_t e = 0; e < cell.n_elements(); e++)
+            {
+                const uint32_t *nodes = cell.element_nodes(e);
+                uint32_t triangle[3] = { local[nodes[0]], local[nodes[1]], local[nodes[2]] };
+                plane.add_element(element_type::tri, triangle, 0);
+            }
+        }
+
+    cout << "Patch meshing of 2D plane successful: " << nx << " x " << ny << " cells of " << cell.n_elements() << " elements and "
+         << n_margin_elements << " margin elements, created " << plane.n_nodes() << " nodes and " << plane.n_elements() << " elements..." << endl;
+    return true;
+}
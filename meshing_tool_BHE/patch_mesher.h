@@ -0,0 +1,18 @@
+#ifndef PATCH_MESHER_H
+#define PATCH_MESHER_H
+
+#include <vector>
+
+#include "compact_mesh.h"
+#include "meshing_tool_BHE.h"
+
+// Patch meshing of regular BHE arrays (-mesher patch): if the BHEs form a full rectangular grid
+// of equal radius, the square cell around one BHE is meshed once and translated over the array.
+// The cell grades from the BHE size at its center to the size around the array (BOX or corner size,
+// or SIZE_FIELD if given) at its corners, so the array isn't meshed uniformly at BHE size.
+// Nodes on shared cell sides are merged by their position along the side, so the cell mesh must
+// be periodic. Only the margin between the array and the model boundary is meshed as a whole,
+// with the array as a hole. Falls back to MeshPlane if any of this doesn't apply.
+bool MeshPlanePatched(const geometry &geom, const std::vector<bhe> &BHEs, const std::vector<additional_point> &add_points, compact_mesh &plane);
+
+#endif //PATCH_MESHER_H
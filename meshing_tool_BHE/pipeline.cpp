@@ -0,0 +1,69 @@
+#include "pch.h"
+#include "pipeline.h"
+
+using namespace std;
+
+void process_limit::acquire()
+{
+    unique_lock<mutex> lock(mutex_);
+    released_.wait(lock, [this]() { return n_free_ > 0; });
+    n_free_--;
+}
+
+void process_limit::release()
+{
+    {
+        lock_guard<mutex> lock(mutex_);
+        n_free_++;
+    }
+    released_.notify_one();
+}
+
+bool shared_planes::get(uint64_t key, compact_mesh &plane, const function<bool(compact_mesh &plane)> &create)
+{
+    promise<shared_ptr<const compact_mesh>> created;
+    shared_future<shared_ptr<const compact_mesh>> result;
+    bool creator = false;
+
+    if (finished_.get_plane(key, plane))
+        return true;
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        auto it = creating_.find(key);
+        if (it != creating_.end())
+            result = it->second;
+        else if (finished_.get_plane(key, plane))
+            return true;    // finished since the first look
+        else
+        {
+            result = created.get_future().share();
+            creating_[key] = result;
+            creator = true;
+        }
+    }
+
+    if (creator)
+    {
+        // Failed planes are published as null, waiting runs fail as well
+        shared_ptr<compact_mesh> new_plane = make_shared<compact_mesh>();
+        if (!create(*new_plane))
+            new_plane.reset();
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            if (new_plane)
+                finished_.put_plane(key, *new_plane);
+            creating_.erase(key);
+        }
+        created.set_value(new_plane);
+    }
+
+    // The waiting runs hold the plane until they have copied it
+    shared_ptr<const compact_mesh> shared_plane = result.get();
+    if (!shared_plane)
+        return false;
+
+    plane = *shared_plane;
+    return true;
+}
@@ -0,0 +1,128 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <istream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "instrumentation.h"
+#include "memory_cache.h"
+#include "meshing_tool_BHE.h"
+#include "process.h"
+
+// Command line options of one run
+struct run_options
+{
+    bool gmsh_only = false;
+    bool write_msh = true, write_vtu = false;
+    bool write_gli = true;
+    bool materialize = false;
+    bool check_mesh = false;
+    bool write_boundary = false;    // node and face sets of the six model surfaces
+    bool native_mesher = false;
+    bool patch_arrays = false;      // native mesher, regular BHE arrays meshed by replicating one cell
+    bool recombine_quads = false;   // gmsh mesher, quadrilaterals extruded to hexahedra
+    bool incremental = false;       // remesh the last plane of the layout around changed BHEs (needs the cache)
+    bool renumber_plane = false;    // Reverse Cuthill-McKee on the 2D plane
+    bool column_major = false;      // z varies fastest in the 3D numbering
+    std::string cache_directory;
+    int n_threads = 1;
+#ifdef _WIN32
+    std::string gmsh_path = "gmsh.exe";
+#else
+    std::string gmsh_path = "gmsh";
+#endif
+    int gmsh_threads = 0;           // 0: GMSH default
+    double gmsh_timeout = 3600;     // seconds, <= 0: no limit
+    int n_plane_parts = 1, n_level_parts = 1;   // partitioned output if more than one partition
+};
+
+// Counts and wall times (seconds) of one run
+struct run_statistics
+{
+    bool ok = false;
+    size_t n_plane_nodes = 0, n_plane_elements = 0;
+    size_t n_nodes = 0, n_elements = 0;
+    double time_read = 0, time_plane = 0, time_extrude = 0, time_write = 0, time_total = 0;
+};
+
+// Limits the number of concurrently running external processes (gmsh)
+class process_limit
+{
+public:
+    explicit process_limit(int n_slots) : n_free_(n_slots) {}
+
+    void acquire();
+    void release();
+
+private:
+    std::mutex mutex_;
+    std::condition_variable released_;
+    int n_free_;
+};
+
+// 2D planes shared between runs in one process, keyed by PlaneKey
+// The first run asking for a key creates the plane, runs asking meanwhile wait for it and copy it.
+// Finished planes are kept in an LRU cache of capacity_bytes, later runs copy them from there.
+class shared_planes
+{
+public:
+    explicit shared_planes(size_t capacity_bytes) : finished_(capacity_bytes) {}
+
+    bool get(uint64_t key, compact_mesh &plane, const std::function<bool(compact_mesh &plane)> &create);
+
+private:
+    std::mutex mutex_;
+    std::map<uint64_t, std::shared_future<std::shared_ptr<const compact_mesh>>> creating_;
+    memory_cache finished_;
+};
+
+// Optional state shared by the runs of a batch
+struct run_context
+{
+    shared_planes *planes = nullptr;
+    process_limit *gmsh_processes = nullptr;
+    memory_cache *memory = nullptr;     // planes and extruded meshes kept in memory (server mode)
+};
+
+// Pipeline stages, each prints its result and returns false on errors
+// Readers and writers given bytes_read/bytes_written add the bytes that actually went from or to disk
+bool ReadInputFile(const std::string &input_filename, std::string &project_name, geometry &geom, std::vector<layer> &layers, std::vector<bhe> &BHEs,
+                   std::vector<additional_point> &add_points, uint64_t *bytes_read = nullptr);
+// Same syntax from a stream, input_filename names the source and locates relative BHE_FILEs
+bool ReadInputStream(std::istream &input, const std::string &input_filename, std::string &project_name, geometry &geom, std::vector<layer> &layers,
+                     std::vector<bhe> &BHEs, std::vector<additional_point> &add_points, uint64_t *bytes_read = nullptr);
+// recombine: quadrilateral-dominant plane, gmsh recombines the triangles
+bool WriteGMSHgeo(const std::string project_name, const geometry &geom, const std::vector<bhe> &BHEs, const std::vector<additional_point> &add_points,
+                  const bool recombine = false);
+bool StartGMSH(const std::string project_name, const run_options &options, child_process &gmsh);
+bool WaitGMSH(const std::string project_name, const run_options &options, child_process &gmsh);
+bool ImportGMSHmsh(const std::string project_name, compact_mesh &plane);
+bool ExtrudeMesh(extruded_mesh &mesh, const std::vector<layer> &layers, int &cnt_mat_groups);
+// Levels at the top, the material boundaries and all BHE ends, graded in between (AUTO_LAYERS)
+bool ExtrudeMeshGraded(extruded_mesh &mesh, const geometry &geom, const std::vector<layer> &layers, const std::vector<bhe> &BHEs, int &cnt_mat_groups);
+bool ComputeBHEelements(const std::vector<bhe> &BHEs, extruded_mesh &mesh, const double tolerance, const int n_mat_groups);
+bool WriteGLI(const std::string project_name, const geometry &geom, const std::vector<bhe> &BHEs, const std::vector<additional_point> &add_points,
+              uint64_t *bytes_written = nullptr);
+// Checks the BHE ends against the extrusion levels, needs no 2D mesh
+bool ValidateBHEdepths(const std::vector<bhe> &BHEs, const std::vector<double> &z_levels, const double tolerance);
+
+// Meshes a model in memory: 2D plane, extrusion, BHE elements and the optional check, no mesh outputs
+// project_name names the gmsh files and the .gli (unless write_gli is off)
+bool BuildMesh(const std::string &project_name, const model_description &model, const run_options &options, const run_context &context,
+               extruded_mesh &mesh, run_statistics &stats, run_report &report);
+
+// Reads input_filename, meshes, extrudes and writes the outputs
+bool RunPipeline(const std::string &input_filename, const run_options &options, const run_context &context, run_statistics &stats);
+
+#endif //PIPELINE_H
@@ -0,0 +1,1137 @@
+#include "pch.h"
+#include "plane_mesher.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <unordered_map>
+#include <utility>
+
+#include "spatial_hash.h"
+
+using namespace std;
+
+namespace
+{
+
+struct dt_triangle
+{
+    int v[3];       // vertices, counter-clockwise
+    int n[3];       // neighbor across the edge opposite v[i], -1 on the hull
+    bool fixed[3];  // edge opposite v[i] is a constrained subsegment
+    bool alive;
+};
+
+// Edge on the boundary of an insertion cavity, counter-clockwise seen from inside
+struct cavity_edge
+{
+    int a, b;
+    int outside;
+    bool fixed;
+};
+
+struct segment
+{
+    int a, b;
+};
+
+// Triangles larger than this times the local size are refined (equilateral edge ~ 1.56 size, similar node count to GMSH)
+const double size_factor = 0.9;
+// Triangles with circumradius / shortest edge above this are refined (minimum angle ~ 20.7 degrees)
+const double quality_bound = 1.4142135623730951;
+const size_t max_vertices = 100000000;
+// Local remeshing replaces the triangles within this times alpha * radius of a changed BHE
+const double remesh_radius_factor = 4.0;
+
+// Incremental Delaunay triangulation (Bowyer-Watson) with constrained edges and a size per vertex
+// Vertices 0..2 form a super triangle that encloses the domain
+class delaunay_triangulation
+{
+public:
+    vector<double> x, y, h;
+    vector<dt_triangle> triangles;
+
+    void Init(double xmin, double ymin, double xmax, double ymax);
+
+    int AddPoint(double px, double py, double ph, int &hint);
+    int SplitEdge(int t, int i);
+    bool BuildCavity(double px, double py, int seed_a, int seed_b);
+    int CommitCavity(double px, double py, double ph, int split_a, int split_b);
+    int Locate(double px, double py, int start, bool stop_at_fixed, int &crossed_t, int &crossed_i) const;
+
+    bool FindEdge(int a, int b, int &t, int &i) const;
+    int CollinearNeighbor(int a, int b) const;
+    void FixEdge(int t, int i);
+
+    double SizeAt(double px, double py, int &hint) const;
+    bool IsSuper(int t) const { return triangles[t].v[0] < 3 || triangles[t].v[1] < 3 || triangles[t].v[2] < 3; }
+    size_t n_vertices() const { return x.size(); }
+
+    double Orient(int a, int b, double px, double py) const
+    {
+        return (x[b] - x[a]) * (py - y[a]) - (y[b] - y[a]) * (px - x[a]);
+    }
+
+    vector<cavity_edge> cavity_boundary;
+    vector<int> created;    // triangles of the last insertion
+
+private:
+    int NewTriangle();
+    bool InCircle(int t, double px, double py) const;
+
+    vector<int> free_triangles_;
+    vector<int> vertex_triangle_;
+    vector<int> mark_;
+    int stamp_ = 0;
+    vector<int> cavity_;
+    int seed_a_ = -1, seed_b_ = -1;
+};
+
+void delaunay_triangulation::Init(double xmin, double ymin, double xmax, double ymax)
+{
+    double cx = 0.5 * (xmin + xmax), cy = 0.5 * (ymin + ymax);
+    double r = 10.0 * max(xmax - xmin, ymax - ymin);
+
+    x = { cx - 2.0 * r, cx + 2.0 * r, cx };
+    y = { cy - r, cy - r, cy + 2.0 * r };
+    h = { 0.0, 0.0, 0.0 };
+    vertex_triangle_ = { 0, 0, 0 };
+
+    dt_triangle super;
+    super.v[0] = 0; super.v[1] = 1; super.v[2] = 2;
+    super.n[0] = super.n[1] = super.n[2] = -1;
+    super.fixed[0] = super.fixed[1] = super.fixed[2] = false;
+    super.alive = true;
+    triangles.assign(1, super);
+    mark_.assign(1, 0);
+}
+
+int delaunay_triangulation::NewTriangle()
+{
+    if (!free_triangles_.empty())
+    {
+        int t = free_triangles_.back();
+        free_triangles_.pop_back();
+        return t;
+    }
+    triangles.emplace_back();
+    mark_.push_back(0);
+    return static_cast<int>(triangles.size() - 1);
+}
+
+bool delaunay_triangulation::InCircle(int t, double px, double py) const
+{
+    const int *v = triangles[t].v;
+    double adx = x[v[0]] - px, ady = y[v[0]] - py;
+    double bdx = x[v[1]] - px, bdy = y[v[1]] - py;
+    double cdx = x[v[2]] - px, cdy = y[v[2]] - py;
+
+    double det = (adx * adx + ady * ady) * (bdx * cdy - cdx * bdy)
+               + (bdx * bdx + bdy * bdy) * (cdx * ady - adx * cdy)
+               + (cdx * cdx + cdy * cdy) * (adx * bdy - bdx * ady);
+    return det > 0;
+}
+
+int delaunay_triangulation::Locate(double px, double py, int start, bool stop_at_fixed, int &crossed_t, int &crossed_i) const
+{
+    int t = start;
+    size_t max_steps = triangles.size() + 16;
+
+    // Visibility walk, the start edge rotates to avoid cycling
+    for (size_t step = 0; step < max_steps; step++)
+    {
+        const dt_triangle &tri = triangles[t];
+        int next = -1;
+
+        for (int k = 0; k < 3; k++)
+        {
+            int i = static_cast<int>((k + step) % 3);
+            if (Orient(tri.v[(i + 1) % 3], tri.v[(i + 2) % 3], px, py) < 0)
+            {
+                if (stop_at_fixed && tri.fixed[i])
+                {
+                    crossed_t = t;
+                    crossed_i = i;
+                    return -1;
+                }
+                next = tri.n[i];
+                break;
+            }
+        }
+
+        if (next < 0)
+            return t;
+        t = next;
+    }
+
+    // Fall back to a linear search
+    for (size_t k = 0; k < triangles.size(); k++)
+    {
+        const dt_triangle &tri = triangles[k];
+        if (tri.alive && Orient(tri.v[1], tri.v[2], px, py) >= 0 && Orient(tri.v[2], tri.v[0], px, py) >= 0 && Orient(tri.v[0], tri.v[1], px, py) >= 0)
+            return static_cast<int>(k);
+    }
+    return -1;
+}
+
+bool delaunay_triangulation::BuildCavity(double px, double py, int seed_a, int seed_b)
+{
+    stamp_++;
+    cavity_.clear();
+    seed_a_ = seed_a;
+    seed_b_ = seed_b;
+
+    mark_[seed_a] = stamp_;
+    cavity_.push_back(seed_a);
+    if (seed_b >= 0)
+    {
+        mark_[seed_b] = stamp_;
+        cavity_.push_back(seed_b);
+    }
+
+    // Grow over triangles whose circumcircle contains p, constrained edges are walls
+    for (size_t k = 0; k < cavity_.size(); k++)
+    {
+        const dt_triangle &tri = triangles[cavity_[k]];
+        for (int i = 0; i < 3; i++)
+        {
+            int nb = tri.n[i];
+            if (nb < 0 || mark_[nb] == stamp_ || tri.fixed[i])
+                continue;
+            if (InCircle(nb, px, py))
+            {
+                mark_[nb] = stamp_;
+                cavity_.push_back(nb);
+            }
+        }
+    }
+
+    // Collect the boundary, drop triangles that make the cavity not star-shaped around p
+    for (;;)
+    {
+        cavity_boundary.clear();
+        int offending = -1;
+
+        for (int t : cavity_)
+        {
+            const dt_triangle &tri = triangles[t];
+            for (int i = 0; i < 3; i++)
+            {
+                int nb = tri.n[i];
+                bool inside = (nb >= 0 && mark_[nb] == stamp_);
+
+                // A constrained edge inside the cavity would be lost (only the split edge may be)
+                if (inside && tri.fixed[i] && !((t == seed_a && nb == seed_b) || (t == seed_b && nb == seed_a)))
+                    return false;
+                if (inside)
+                    continue;
+
+                cavity_edge edge;
+                edge.a = tri.v[(i + 1) % 3];
+                edge.b = tri.v[(i + 2) % 3];
+                edge.outside = nb;
+                edge.fixed = tri.fixed[i];
+                cavity_boundary.push_back(edge);
+
+                if (offending < 0 && Orient(edge.a, edge.b, px, py) <= 0)
+                    offending = t;
+            }
+        }
+
+        if (offending < 0)
+            return true;
+        if (offending == seed_a || offending == seed_b)
+            return false;
+
+        mark_[offending] = 0;
+        cavity_.erase(find(cavity_.begin(), cavity_.end(), offending));
+    }
+}
+
+int delaunay_triangulation::CommitCavity(double px, double py, double ph, int split_a, int split_b)
+{
+    int p = static_cast<int>(x.size());
+    x.push_back(px);
+    y.push_back(py);
+    h.push_back(ph);
+    vertex_triangle_.push_back(-1);
+
+    for (int t : cavity_)
+    {
+        triangles[t].alive = false;
+        free_triangles_.push_back(t);
+    }
+
+    size_t n_new = cavity_boundary.size();
+    created.resize(n_new);
+
+    for (size_t k = 0; k < n_new; k++)
+    {
+        const cavity_edge &edge = cavity_boundary[k];
+        int t = NewTriangle();
+        created[k] = t;
+
+        dt_triangle &tri = triangles[t];
+        tri.v[0] = p;
+        tri.v[1] = edge.a;
+        tri.v[2] = edge.b;
+        tri.n[0] = edge.outside;
+        tri.n[1] = tri.n[2] = -1;
+        tri.fixed[0] = edge.fixed;
+        tri.fixed[1] = (edge.b == split_a || edge.b == split_b);
+        tri.fixed[2] = (edge.a == split_a || edge.a == split_b);
+        tri.alive = true;
+        mark_[t] = 0;
+
+        // Point the outside neighbor back to the new triangle
+        if (edge.outside >= 0)
+        {
+            dt_triangle &out = triangles[edge.outside];
+            for (int j = 0; j < 3; j++)
+                if (out.v[(j + 1) % 3] == edge.b && out.v[(j + 2) % 3] == edge.a)
+                    out.n[j] = t;
+        }
+
+        vertex_triangle_[p] = t;
+        vertex_triangle_[edge.a] = t;
+        vertex_triangle_[edge.b] = t;
+    }
+
+    // Link the new triangles around p: edge (b, p) of one is edge (p, a') of the next
+    for (size_t k = 0; k < n_new; k++)
+    {
+        dt_triangle &tri = triangles[created[k]];
+        for (size_t l = 0; l < n_new; l++)
+        {
+            if (cavity_boundary[l].a == tri.v[2])
+                tri.n[1] = created[l];
+            if (cavity_boundary[l].b == tri.v[1])
+                tri.n[2] = created[l];
+        }
+    }
+
+    return p;
+}
+
+int delaunay_triangulation::AddPoint(double px, double py, double ph, int &hint)
+{
+    int crossed_t, crossed_i;
+    int t = Locate(px, py, hint, false, crossed_t, crossed_i);
+    if (t < 0)
+        return -1;
+
+    // Coinciding points are merged, the smaller size wins
+    double scale = max(fabs(x[2] - x[0]), fabs(y[2] - y[0]));
+    double eps = 1.0e-12 * scale;
+    for (int k = 0; k < 3; k++)
+    {
+        int v = triangles[t].v[k];
+        if (fabs(x[v] - px) <= eps && fabs(y[v] - py) <= eps)
+        {
+            if (ph > 0 && (h[v] <= 0 || ph < h[v]))
+                h[v] = ph;
+            hint = t;
+            return v;
+        }
+    }
+
+    if (!BuildCavity(px, py, t, -1))
+        return -1;
+
+    int p = CommitCavity(px, py, ph, -1, -1);
+    hint = vertex_triangle_[p];
+    return p;
+}
+
+int delaunay_triangulation::SplitEdge(int t, int i)
+{
+    int a = triangles[t].v[(i + 1) % 3];
+    int b = triangles[t].v[(i + 2) % 3];
+    int nb = triangles[t].n[i];
+    double mx = 0.5 * (x[a] + x[b]);
+    double my = 0.5 * (y[a] + y[b]);
+
+    if (!BuildCavity(mx, my, t, nb))
+        return -1;
+
+    return CommitCavity(mx, my, 0.5 * (h[a] + h[b]), a, b);
+}
+
+bool delaunay_triangulation::FindEdge(int a, int b, int &t, int &i) const
+{
+    // Rotate around a, the fan is closed for all non-super vertices
+    int start = vertex_triangle_[a];
+    int cur = start;
+
+    do
+    {
+        const dt_triangle &tri = triangles[cur];
+        int k = (tri.v[0] == a) ? 0 : (tri.v[1] == a) ? 1 : 2;
+
+        if (tri.v[(k + 1) % 3] == b)
+        {
+            t = cur;
+            i = (k + 2) % 3;
+            return true;
+        }
+        if (tri.v[(k + 2) % 3] == b)
+        {
+            t = cur;
+            i = (k + 1) % 3;
+            return true;
+        }
+
+        cur = tri.n[(k + 2) % 3];
+    } while (cur >= 0 && cur != start);
+
+    return false;
+}
+
+int delaunay_triangulation::CollinearNeighbor(int a, int b) const
+{
+    // Vertex adjacent to a that lies on the open segment (a, b)
+    double dx = x[b] - x[a], dy = y[b] - y[a];
+    double len2 = dx * dx + dy * dy;
+    int start = vertex_triangle_[a];
+    int cur = start;
+
+    do
+    {
+        const dt_triangle &tri = triangles[cur];
+        int k = (tri.v[0] == a) ? 0 : (tri.v[1] == a) ? 1 : 2;
+        int c = tri.v[(k + 1) % 3];
+        double cx = x[c] - x[a], cy = y[c] - y[a];
+        double along = cx * dx + cy * dy;
+
+        if (c >= 3 && fabs(cx * dy - cy * dx) <= 1.0e-10 * len2 && along > 0 && along < len2)
+            return c;
+
+        cur = tri.n[(k + 2) % 3];
+    } while (cur >= 0 && cur != start);
+
+    return -1;
+}
+
+void delaunay_triangulation::FixEdge(int t, int i)
+{
+    dt_triangle &tri = triangles[t];
+    tri.fixed[i] = true;
+
+    int nb = tri.n[i];
+    if (nb < 0)
+        return;
+
+    dt_triangle &other = triangles[nb];
+    for (int j = 0; j < 3; j++)
+        if (other.n[j] == t)
+            other.fixed[j] = true;
+}
+
+double delaunay_triangulation::SizeAt(double px, double py, int &hint) const
+{
+    int crossed_t, crossed_i;
+    int t = Locate(px, py, hint, false, crossed_t, crossed_i);
+    if (t < 0)
+        return 0;
+    hint = t;
+
+    // Barycentric interpolation of the vertex sizes
+    const int *v = triangles[t].v;
+    double area = Orient(v[0], v[1], x[v[2]], y[v[2]]);
+    double w0 = Orient(v[1], v[2], px, py) / area;
+    double w1 = Orient(v[2], v[0], px, py) / area;
+    double w2 = 1.0 - w0 - w1;
+
+    if (v[0] < 3 || v[1] < 3 || v[2] < 3)
+    {
+        // Outside the domain (not expected), use the real vertices only
+        double sum = 0;
+        int cnt = 0;
+        for (int k = 0; k < 3; k++)
+            if (v[k] >= 3)
+            {
+                sum += h[v[k]];
+                cnt++;
+            }
+        return cnt > 0 ? sum / cnt : 0;
+    }
+
+    return w0 * h[v[0]] + w1 * h[v[1]] + w2 * h[v[2]];
+}
+
+// Splits a straight line into pieces following the linearly interpolated size (as GMSH does)
+void DiscretizeLine(delaunay_triangulation &dt, int a, int b, vector<segment> &segments, int &hint)
+{
+    double length = hypot(dt.x[b] - dt.x[a], dt.y[b] - dt.y[a]);
+    double h0 = dt.h[a], h1 = dt.h[b];
+    double integral = (fabs(h1 - h0) < 1.0e-12 * h0) ? length / h0 : length * log(h1 / h0) / (h1 - h0);
+    int n = max(1, static_cast<int>(floor(integral + 0.5)));
+    int prev = a;
+
+    for (int k = 1; k < n; k++)
+    {
+        // Position s where the integral of 1/h reaches k/n of the total
+        double s;
+        if (fabs(h1 - h0) < 1.0e-12 * h0)
+            s = length * k / n;
+        else
+            s = (h0 * exp(integral * k / n * (h1 - h0) / length) - h0) * length / (h1 - h0);
+
+        double t = s / length;
+        int v = dt.AddPoint(dt.x[a] + t * (dt.x[b] - dt.x[a]), dt.y[a] + t * (dt.y[b] - dt.y[a]), h0 + t * (h1 - h0), hint);
+        if (v < 0)
+            continue;
+
+        segments.push_back({ prev, v });
+        prev = v;
+    }
+
+    segments.push_back({ prev, b });
+}
+
+// Delaunay refinement: insert circumcenters of too large or badly shaped triangles,
+// encroached subsegments are split instead unless kept(a, b); excluded(t) triangles are skipped
+template <typename Excluded, typename Kept>
+bool RefineMesh(delaunay_triangulation &dt, const delaunay_triangulation &background, int &size_hint, Excluded excluded, Kept kept)
+{
+    vector<int> queue;
+    for (size_t t = 0; t < dt.triangles.size(); t++)
+        if (dt.triangles[t].alive)
+            queue.push_back(static_cast<int>(t));
+
+    while (!queue.empty())
+    {
+        int t = queue.back();
+        queue.pop_back();
+
+        if (!dt.triangles[t].alive || dt.IsSuper(t) || excluded(t))
+            continue;
+
+        const int *v = dt.triangles[t].v;
+        double ax = dt.x[v[0]], ay = dt.y[v[0]];
+        double bx = dt.x[v[1]] - ax, by = dt.y[v[1]] - ay;
+        double cx = dt.x[v[2]] - ax, cy = dt.y[v[2]] - ay;
+        double d = 2.0 * (bx * cy - by * cx);
+        if (d <= 0)
+            continue;
+
+        double b2 = bx * bx + by * by, c2 = cx * cx + cy * cy;
+        double ux = (cy * b2 - by * c2) / d;
+        double uy = (bx * c2 - cx * b2) / d;
+        double radius2 = ux * ux + uy * uy;
+        double ex = cx - bx, ey = cy - by;
+        double shortest2 = min(min(b2, c2), ex * ex + ey * ey);
+
+        double size = background.SizeAt(ax + (bx + cx) / 3.0, ay + (by + cy) / 3.0, size_hint);
+        bool too_large = radius2 > size_factor * size_factor * size * size;
+        bool bad_shape = radius2 > quality_bound * quality_bound * shortest2;
+        if (!too_large && !bad_shape)
+            continue;
+
+        if (dt.n_vertices() > max_vertices)
+        {
+            cout << "Error: 2D mesh exceeds " << max_vertices << " nodes!" << endl;
+            return false;
+        }
+
+        double px = ax + ux, py = ay + uy;
+        int crossed_t = -1, crossed_i = -1;
+        int split_t = -1, split_i = -1;
+        int p = -1;
+
+        int located = dt.Locate(px, py, t, true, crossed_t, crossed_i);
+        if (located < 0)
+        {
+            // Circumcenter behind a boundary or box line
+            split_t = crossed_t;
+            split_i = crossed_i;
+        }
+        else if (dt.BuildCavity(px, py, located, -1))
+        {
+            // Subsegments whose diametral circle contains the circumcenter are split first
+            for (const cavity_edge &edge : dt.cavity_boundary)
+            {
+                if (!edge.fixed)
+                    continue;
+                double dot = (dt.x[edge.a] - px) * (dt.x[edge.b] - px) + (dt.y[edge.a] - py) * (dt.y[edge.b] - py);
+                if (dot < 0)
+                {
+                    int et, ei;
+                    if (dt.FindEdge(edge.a, edge.b, et, ei))
+                    {
+                        split_t = et;
+                        split_i = ei;
+                    }
+                    break;
+                }
+            }
+
+            if (split_t < 0)
+                p = dt.CommitCavity(px, py, 0, -1, -1);
+        }
+
+        // Kept subsegments aren't split, the triangle stays as it is
+        if (split_t >= 0 && kept(dt.triangles[split_t].v[(split_i + 1) % 3], dt.triangles[split_t].v[(split_i + 2) % 3]))
+            continue;
+
+        if (split_t >= 0)
+        {
+            p = dt.SplitEdge(split_t, split_i);
+            if (p >= 0 && dt.triangles[t].alive)
+                queue.push_back(t);
+        }
+
+        if (p < 0)
+            continue;
+
+        // New triangles are checked again
+        queue.insert(queue.end(), dt.created.begin(), dt.created.end());
+    }
+
+    return true;
+}
+
+} // namespace
+
+bool MeshPlane(const geometry &geom, const vector<bhe> &BHEs, const vector<additional_point> &add_points, compact_mesh &plane, const plane_hole *hole)
+{
+    // Declarations
+    delaunay_triangulation dt;
+    vector<segment> segments;
+    vector<int> lines;
+    int hint = 0;
+    bool has_box = !(geom.box_length == -1 || geom.box_start == -1 || geom.box_width == -1);
+
+    double xmin = -geom.width / 2.0, xmax = geom.width / 2.0;
+    double ymin = 0.0, ymax = geom.length;
+    dt.Init(xmin, ymin, xmax, ymax);
+
+    // Hole nodes first, they become nodes 0..n-1 of the plane
+    int n_hole = (hole == nullptr) ? 0 : static_cast<int>(hole->x.size());
+    auto is_hole_segment = [&](int a, int b) { return a >= 3 && a < 3 + n_hole && b >= 3 && b < 3 + n_hole; };
+    for (int k = 0; k < n_hole; k++)
+        if (dt.AddPoint(hole->x[k], hole->y[k], hole->size, hint) != 3 + k)
+        {
+            cout << "Error: Couldn't insert the hole boundary into the 2D mesh!" << endl;
+            return false;
+        }
+
+    // Model boundaries
+    int corners[4];
+    corners[0] = dt.AddPoint(xmin, ymin, geom.elem_size_corner, hint);
+    corners[1] = dt.AddPoint(xmax, ymin, geom.elem_size_corner, hint);
+    corners[2] = dt.AddPoint(xmax, ymax, geom.elem_size_corner, hint);
+    corners[3] = dt.AddPoint(xmin, ymax, geom.elem_size_corner, hint);
+    for (int k = 0; k < 4; k++)
+    {
+        lines.push_back(corners[k]);
+        lines.push_back(corners[(k + 1) % 4]);
+    }
+
+    // Bounding box
+    if (has_box)
+    {
+        int box[4];
+        box[0] = dt.AddPoint(geom.box_width / 2.0, geom.box_start, geom.elem_size_box, hint);
+        box[1] = dt.AddPoint(-geom.box_width / 2.0, geom.box_start, geom.elem_size_box, hint);
+        box[2] = dt.AddPoint(-geom.box_width / 2.0, geom.box_start + geom.box_length, geom.elem_size_box, hint);
+        box[3] = dt.AddPoint(geom.box_width / 2.0, geom.box_start + geom.box_length, geom.elem_size_box, hint);
+        for (int k = 0; k < 4; k++)
+        {
+            lines.push_back(box[k]);
+            lines.push_back(box[(k + 1) % 4]);
+        }
+    }
+
+    // BHEs: center and hexagon
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        double delta = bhe_alpha * BHEs[i].bhe_radius;
+        dt.AddPoint(BHEs[i].bhe_x, BHEs[i].bhe_y, delta, hint);
+        for (int k = 0; k < 6; k++)
+            dt.AddPoint(BHEs[i].bhe_x + bhe_hexagon_x[k] * delta, BHEs[i].bhe_y + bhe_hexagon_y[k] * delta, delta, hint);
+    }
+
+    // Additional points with own size
+    for (size_t i = 0; i < add_points.size(); i++)
+        if (add_points[i].delta > 0)
+            dt.AddPoint(add_points[i].x, add_points[i].y, add_points[i].delta, hint);
+
+    // Discretize boundary and box lines according to the point sizes
+    for (size_t k = 0; k < lines.size(); k += 2)
+    {
+        if (lines[k] < 0 || lines[k + 1] < 0)
+        {
+            cout << "Error: Couldn't insert the model boundary into the 2D mesh!" << endl;
+            return false;
+        }
+        DiscretizeLine(dt, lines[k], lines[k + 1], segments, hint);
+    }
+    for (int k = 0; k < n_hole; k++)
+        segments.push_back({ 3 + k, 3 + (k + 1) % n_hole });
+
+    // Recover the subsegments as edges, missing ones are split (conforming Delaunay)
+    for (size_t k = 0; k < segments.size(); k++)
+    {
+        segment seg = segments[k];
+        int t, i;
+
+        if (seg.a == seg.b)
+            continue;
+
+        if (dt.FindEdge(seg.a, seg.b, t, i))
+        {
+            dt.FixEdge(t, i);
+            continue;
+        }
+
+        if (is_hole_segment(seg.a, seg.b))
+        {
+            cout << "Error: Couldn't recover the hole boundary in the 2D mesh!" << endl;
+            return false;
+        }
+
+        int c = dt.CollinearNeighbor(seg.a, seg.b);
+        if (c < 0)
+        {
+            double mx = 0.5 * (dt.x[seg.a] + dt.x[seg.b]);
+            double my = 0.5 * (dt.y[seg.a] + dt.y[seg.b]);
+            c = dt.AddPoint(mx, my, 0.5 * (dt.h[seg.a] + dt.h[seg.b]), hint);
+        }
+        if (c < 0 || dt.n_vertices() > max_vertices)
+        {
+            cout << "Error: Couldn't recover the boundary lines in the 2D mesh!" << endl;
+            return false;
+        }
+
+        segments.push_back({ seg.a, c });
+        segments.push_back({ c, seg.b });
+    }
+
+    // Triangles inside the hole: left of the counter-clockwise boundary, bounded by the fixed edges
+    vector<char> in_hole(dt.triangles.size(), 0);
+    if (n_hole > 0)
+    {
+        int t, i;
+        if (!dt.FindEdge(3, 4, t, i))
+        {
+            cout << "Error: Couldn't recover the hole boundary in the 2D mesh!" << endl;
+            return false;
+        }
+        if (dt.triangles[t].v[(i + 1) % 3] != 3)
+            t = dt.triangles[t].n[i];
+        if (t < 0)
+        {
+            cout << "Error: Couldn't find the hole in the 2D mesh!" << endl;
+            return false;
+        }
+        vector<int> stack(1, t);
+        in_hole[t] = 1;
+        while (!stack.empty())
+        {
+            const dt_triangle &tri = dt.triangles[stack.back()];
+            stack.pop_back();
+            for (int k = 0; k < 3; k++)
+                if (!tri.fixed[k] && tri.n[k] >= 0 && !in_hole[tri.n[k]])
+                {
+                    in_hole[tri.n[k]] = 1;
+                    stack.push_back(tri.n[k]);
+                }
+        }
+    }
+    auto is_hole_triangle = [&](size_t t) { return t < in_hole.size() && in_hole[t]; };
+
+    // Sizes are interpolated over the triangulation of all sized points
+    const delaunay_triangulation background = dt;
+    int size_hint = hint;
+
+    // Additional points without size take the local size
+    for (size_t i = 0; i < add_points.size(); i++)
+        if (add_points[i].delta <= 0)
+            dt.AddPoint(add_points[i].x, add_points[i].y, background.SizeAt(add_points[i].x, add_points[i].y, size_hint), hint);
+
+    // Delaunay refinement outside the hole, the hole boundary is kept
+    if (!RefineMesh(dt, background, size_hint, is_hole_triangle, is_hole_segment))
+        return false;
+
+    // Copy to the plane mesh, dropping the super triangle
+    plane.clear();
+    plane.reserve(dt.n_vertices() - 3, dt.triangles.size(), 3 * dt.triangles.size());
+    for (size_t v = 3; v < dt.n_vertices(); v++)
+        plane.add_node(dt.x[v], dt.y[v], 0.0);
+    for (size_t t = 0; t < dt.triangles.size(); t++)
+    {
+        if (!dt.triangles[t].alive || dt.IsSuper(static_cast<int>(t)) || is_hole_triangle(t))
+            continue;
+        // Clockwise like the plane surface in the GMSH .geo
+        const int *v = dt.triangles[t].v;
+        uint32_t triangle[3] = { static_cast<uint32_t>(v[0] - 3), static_cast<uint32_t>(v[2] - 3), static_cast<uint32_t>(v[1] - 3) };
+        plane.add_element(element_type::tri, triangle, 0);
+    }
+
+    cout << "Meshing 2D plane successful: Created " << plane.n_nodes() << " nodes and " << plane.n_elements() << " elements..." << endl;
+    return true;
+}
+
+// Distance from (px, py) to the segment (ax, ay) - (bx, by)
+static double SegmentDistance(double px, double py, double ax, double ay, double bx, double by)
+{
+    double dx = bx - ax, dy = by - ay;
+    double len2 = dx * dx + dy * dy;
+    double t = (len2 > 0) ? max(0.0, min(1.0, ((px - ax) * dx + (py - ay) * dy) / len2)) : 0.0;
+    return hypot(ax + t * dx - px, ay + t * dy - py);
+}
+
+// Removes the last entries of a node or element array by moving them into the gaps (sorted ascending),
+// returns the moved entries as pairs of old and new index
+static vector<pair<uint32_t, uint32_t>> CloseGaps(const vector<uint32_t> &gaps, size_t n)
+{
+    vector<pair<uint32_t, uint32_t>> moves;
+    size_t n_kept = n - gaps.size();
+    size_t tail = n, g = gaps.size();
+    for (uint32_t gap : gaps)
+    {
+        if (gap >= n_kept)
+            break;
+        // Next entry from the end that isn't a gap itself
+        do
+        {
+            tail--;
+            while (g > 0 && gaps[g - 1] > tail)
+                g--;
+        } while (g > 0 && gaps[g - 1] == tail);
+        moves.emplace_back(static_cast<uint32_t>(tail), gap);
+    }
+    return moves;
+}
+
+bool RemeshPlaneLocally(const geometry &geom, const vector<bhe> &old_BHEs, const vector<bhe> &BHEs, const vector<additional_point> &add_points,
+                        compact_mesh &plane)
+{
+    if (plane.blocks.size() != 1 || plane.blocks[0].type != element_type::tri)
+    {
+        cout << "Warning: Local remeshing needs a triangle plane, remeshing the whole plane!" << endl;
+        return false;
+    }
+
+    // Changed BHEs matched by number: old and new position of moved ones, new of added, old of removed
+    struct disk
+    {
+        double x, y, radius;
+    };
+    vector<disk> disks;
+    vector<char> changed(BHEs.size(), 0);
+    unordered_map<int, size_t> old_index;
+    for (size_t i = 0; i < old_BHEs.size(); i++)
+        old_index[old_BHEs[i].bhe_number] = i;
+    vector<char> matched(old_BHEs.size(), 0);
+
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        auto found = old_index.find(BHEs[i].bhe_number);
+        if (found != old_index.end())
+        {
+            const bhe &old_BHE = old_BHEs[found->second];
+            matched[found->second] = 1;
+            if (old_BHE.bhe_x == BHEs[i].bhe_x && old_BHE.bhe_y == BHEs[i].bhe_y && old_BHE.bhe_radius == BHEs[i].bhe_radius)
+                continue;
+            disks.push_back({ old_BHE.bhe_x, old_BHE.bhe_y, remesh_radius_factor * bhe_alpha * old_BHE.bhe_radius });
+        }
+        disks.push_back({ BHEs[i].bhe_x, BHEs[i].bhe_y, remesh_radius_factor * bhe_alpha * BHEs[i].bhe_radius });
+        changed[i] = 1;
+    }
+    for (size_t i = 0; i < old_BHEs.size(); i++)
+        if (!matched[i])
+            disks.push_back({ old_BHEs[i].bhe_x, old_BHEs[i].bhe_y, remesh_radius_factor * bhe_alpha * old_BHEs[i].bhe_radius });
+
+    if (disks.empty())
+    {
+        cout << "Local remeshing of 2D plane successful: No BHE changed..." << endl;
+        return true;
+    }
+
+    // Box lines would be cut by the region
+    double max_radius = 0;
+    for (const disk &d : disks)
+        max_radius = max(max_radius, d.radius);
+    if (!(geom.box_length == -1 || geom.box_start == -1 || geom.box_width == -1))
+    {
+        double bx[4] = { geom.box_width / 2.0, -geom.box_width / 2.0, -geom.box_width / 2.0, geom.box_width / 2.0 };
+        double by[4] = { geom.box_start, geom.box_start, geom.box_start + geom.box_length, geom.box_start + geom.box_length };
+        for (const disk &d : disks)
+            for (int k = 0; k < 4; k++)
+                if (SegmentDistance(d.x, d.y, bx[k], by[k], bx[(k + 1) % 4], by[(k + 1) % 4]) < d.radius + geom.elem_size_box)
+                {
+                    cout << "Warning: Changed BHE close to the box lines, remeshing the whole plane!" << endl;
+                    return false;
+                }
+    }
+
+    // Region: all triangles that intersect a disk
+    spatial_hash centers(max_radius);
+    centers.reserve(disks.size());
+    for (const disk &d : disks)
+        centers.add(d.x, d.y);
+    centers.build();
+
+    vector<uint32_t> removed;
+    vector<int> close;
+    for (size_t e = 0; e < plane.n_elements(); e++)
+    {
+        const uint32_t *v = plane.element_nodes(e);
+        double cx = (plane.x[v[0]] + plane.x[v[1]] + plane.x[v[2]]) / 3.0;
+        double cy = (plane.y[v[0]] + plane.y[v[1]] + plane.y[v[2]]) / 3.0;
+        double extent = 0;
+        for (int k = 0; k < 3; k++)
+            extent = max(extent, hypot(plane.x[v[k]] - cx, plane.y[v[k]] - cy));
+
+        close.clear();
+        centers.within(cx, cy, max_radius + extent, close);
+        for (int c : close)
+        {
+            const disk &d = disks[c];
+            bool hit = false;
+            double side[3];
+            for (int k = 0; k < 3; k++)
+            {
+                uint32_t a = v[k], b = v[(k + 1) % 3];
+                hit = hit || SegmentDistance(d.x, d.y, plane.x[a], plane.y[a], plane.x[b], plane.y[b]) < d.radius;
+                side[k] = (plane.x[b] - plane.x[a]) * (d.y - plane.y[a]) - (plane.y[b] - plane.y[a]) * (d.x - plane.x[a]);
+            }
+            hit = hit || (side[0] >= 0 && side[1] >= 0 && side[2] >= 0) || (side[0] <= 0 && side[1] <= 0 && side[2] <= 0);
+            if (hit)
+            {
+                removed.push_back(static_cast<uint32_t>(e));
+                break;
+            }
+        }
+    }
+
+    // Region boundary: edges of only one removed triangle, directed with the region on the left
+    map<pair<uint32_t, uint32_t>, int> edge_count;
+    vector<pair<uint32_t, uint32_t>> directed;
+    uint16_t material_group = removed.empty() ? 0 : plane.material_groups[removed[0]];
+    bool clockwise = true;
+    for (uint32_t e : removed)
+    {
+        const uint32_t *v = plane.element_nodes(e);
+        double area2 = (plane.x[v[1]] - plane.x[v[0]]) * (plane.y[v[2]] - plane.y[v[0]]) - (plane.y[v[1]] - plane.y[v[0]]) * (plane.x[v[2]] - plane.x[v[0]]);
+        if (e == removed[0])
+            clockwise = (area2 < 0);
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t a = v[k], b = v[(k + 1) % 3];
+            if (area2 < 0)
+                swap(a, b);
+            directed.emplace_back(a, b);
+            edge_count[make_pair(min(a, b), max(a, b))]++;
+        }
+    }
+
+    vector<pair<uint32_t, uint32_t>> boundary;
+    for (const auto &edge : directed)
+        if (edge_count[make_pair(min(edge.first, edge.second), max(edge.first, edge.second))] == 1)
+            boundary.push_back(edge);
+
+    // Boundary nodes keep their number and get the mean length of their boundary edges as size,
+    // the other nodes of the region are dropped
+    map<uint32_t, pair<double, int>> boundary_size;
+    for (const auto &edge : boundary)
+    {
+        double length = hypot(plane.x[edge.second] - plane.x[edge.first], plane.y[edge.second] - plane.y[edge.first]);
+        for (uint32_t node : { edge.first, edge.second })
+        {
+            boundary_size[node].first += length;
+            boundary_size[node].second++;
+        }
+    }
+    vector<uint32_t> dropped;
+    for (const auto &edge : directed)
+        if (boundary_size.find(edge.first) == boundary_size.end())
+            dropped.push_back(edge.first);
+    sort(dropped.begin(), dropped.end());
+    dropped.erase(unique(dropped.begin(), dropped.end()), dropped.end());
+
+    // Local triangulation of the boundary nodes
+    delaunay_triangulation dt;
+    int hint = 0;
+    double xmin = numeric_limits<double>::max(), ymin = xmin, xmax = -xmin, ymax = -xmin;
+    for (const auto &entry : boundary_size)
+    {
+        xmin = min(xmin, plane.x[entry.first]);
+        xmax = max(xmax, plane.x[entry.first]);
+        ymin = min(ymin, plane.y[entry.first]);
+        ymax = max(ymax, plane.y[entry.first]);
+    }
+    dt.Init(xmin, ymin, xmax, ymax);
+
+    vector<uint32_t> plane_node(3, 0);
+    map<uint32_t, int> dt_node;
+    for (const auto &entry : boundary_size)
+    {
+        int v = dt.AddPoint(plane.x[entry.first], plane.y[entry.first], entry.second.first / entry.second.second, hint);
+        if (v != static_cast<int>(plane_node.size()))
+        {
+            cout << "Warning: Couldn't triangulate the boundary of the changed region, remeshing the whole plane!" << endl;
+            return false;
+        }
+        plane_node.push_back(entry.first);
+        dt_node[entry.first] = v;
+    }
+    int n_kept = static_cast<int>(dt.n_vertices());
+    auto is_boundary_edge = [&](int a, int b) { return a >= 3 && a < n_kept && b >= 3 && b < n_kept; };
+
+    for (const auto &edge : boundary)
+    {
+        int t, i;
+        if (!dt.FindEdge(dt_node[edge.first], dt_node[edge.second], t, i))
+        {
+            cout << "Warning: Couldn't recover the boundary of the changed region, remeshing the whole plane!" << endl;
+            return false;
+        }
+        dt.FixEdge(t, i);
+    }
+
+    // Sized points inside: the changed BHEs, and BHEs and additional points whose nodes were dropped
+    spatial_hash dropped_nodes(max(geom.bhe_tolerance, 1e-12));
+    dropped_nodes.reserve(dropped.size());
+    for (uint32_t node : dropped)
+        dropped_nodes.add(plane.x[node], plane.y[node]);
+    dropped_nodes.build();
+    auto was_dropped = [&](double px, double py) { return dropped_nodes.nearest(px, py, geom.bhe_tolerance) >= 0; };
+
+    vector<additional_point> unsized;
+    for (size_t i = 0; i < BHEs.size(); i++)
+    {
+        double delta = bhe_alpha * BHEs[i].bhe_radius;
+        double px[7] = { BHEs[i].bhe_x }, py[7] = { BHEs[i].bhe_y };
+        for (int k = 0; k < 6; k++)
+        {
+            px[k + 1] = BHEs[i].bhe_x + bhe_hexagon_x[k] * delta;
+            py[k + 1] = BHEs[i].bhe_y + bhe_hexagon_y[k] * delta;
+        }
+        for (int k = 0; k < 7; k++)
+            if (changed[i] || was_dropped(px[k], py[k]))
+                dt.AddPoint(px[k], py[k], delta, hint);
+    }
+    for (size_t i = 0; i < add_points.size(); i++)
+        if (was_dropped(add_points[i].x, add_points[i].y))
+        {
+            if (add_points[i].delta > 0)
+                dt.AddPoint(add_points[i].x, add_points[i].y, add_points[i].delta, hint);
+            else
+                unsized.push_back(add_points[i]);
+        }
+
+    const delaunay_triangulation background = dt;
+    int size_hint = hint;
+    for (const additional_point &point : unsized)
+        dt.AddPoint(point.x, point.y, background.SizeAt(point.x, point.y, size_hint), hint);
+
+    // Triangles of the region: left of the directed boundary, bounded by the fixed edges
+    vector<char> inside(dt.triangles.size(), 0);
+    vector<int> stack;
+    for (const auto &edge : boundary)
+    {
+        int t, i;
+        if (!dt.FindEdge(dt_node[edge.first], dt_node[edge.second], t, i))
+        {
+            cout << "Warning: Lost the boundary of the changed region, remeshing the whole plane!" << endl;
+            return false;
+        }
+        if (dt.triangles[t].v[(i + 1) % 3] != dt_node[edge.first])
+            t = dt.triangles[t].n[i];
+        if (t >= 0 && !inside[t])
+        {
+            inside[t] = 1;
+            stack.push_back(t);
+        }
+    }
+    while (!stack.empty())
+    {
+        const dt_triangle &tri = dt.triangles[stack.back()];
+        stack.pop_back();
+        for (int k = 0; k < 3; k++)
+            if (!tri.fixed[k] && tri.n[k] >= 0 && !inside[tri.n[k]])
+            {
+                inside[tri.n[k]] = 1;
+                stack.push_back(tri.n[k]);
+            }
+    }
+    auto is_outside = [&](size_t t) { return t < inside.size() && !inside[t]; };
+
+    if (!RefineMesh(dt, background, size_hint, is_outside, is_boundary_edge))
+        return false;
+
+    // New nodes fill the dropped node numbers first, new triangles the removed element numbers
+    size_t n_reused_nodes = 0;
+    plane_node.resize(dt.n_vertices(), numeric_limits<uint32_t>::max());
+    for (size_t v = n_kept; v < dt.n_vertices(); v++)
+    {
+        if (n_reused_nodes < dropped.size())
+        {
+            plane_node[v] = dropped[n_reused_nodes++];
+            plane.x[plane_node[v]] = dt.x[v];
+            plane.y[plane_node[v]] = dt.y[v];
+            plane.z[plane_node[v]] = 0.0;
+        }
+        else
+            plane_node[v] = plane.add_node(dt.x[v], dt.y[v], 0.0);
+    }
+
+    size_t n_new = 0;
+    for (size_t t = 0; t < dt.triangles.size(); t++)
+    {
+        if (!dt.triangles[t].alive || dt.IsSuper(static_cast<int>(t)) || is_outside(t))
+            continue;
+        // Same orientation as the previous plane
+        const int *v = dt.triangles[t].v;
+        uint32_t triangle[3] = { plane_node[v[0]], plane_node[clockwise ? v[2] : v[1]], plane_node[clockwise ? v[1] : v[2]] };
+        if (n_new < removed.size())
+        {
+            copy(triangle, triangle + 3, plane.connectivity.begin() + 3 * removed[n_new]);
+            plane.material_groups[removed[n_new]] = material_group;
+        }
+        else
+            plane.add_element(element_type::tri, triangle, material_group);
+        n_new++;
+    }
+
+    // Unused numbers are closed by moving the last nodes and triangles
+    if (n_reused_nodes < dropped.size())
+    {
+        vector<uint32_t> gaps(dropped.begin() + n_reused_nodes, dropped.end());
+        vector<pair<uint32_t, uint32_t>> moves = CloseGaps(gaps, plane.n_nodes());
+        vector<uint32_t> new_index(plane.n_nodes());
+        for (size_t n = 0; n < new_index.size(); n++)
+            new_index[n] = static_cast<uint32_t>(n);
+        for (const auto &move : moves)
+        {
+            plane.x[move.second] = plane.x[move.first];
+            plane.y[move.second] = plane.y[move.first];
+            plane.z[move.second] = plane.z[move.first];
+            new_index[move.first] = move.second;
+        }
+        for (uint32_t &node : plane.connectivity)
+            node = new_index[node];
+        plane.resize_nodes(plane.n_nodes() - gaps.size());
+    }
+    if (n_new < removed.size())
+    {
+        vector<uint32_t> gaps(removed.begin() + n_new, removed.end());
+        for (const auto &move : CloseGaps(gaps, plane.n_elements()))
+        {
+            copy(plane.connectivity.begin() + 3 * move.first, plane.connectivity.begin() + 3 * move.first + 3, plane.connectivity.begin() + 3 * move.second);
+            plane.material_groups[move.second] = plane.material_groups[move.first];
+        }
+        plane.material_groups.resize(plane.n_elements() - gaps.size());
+        plane.connectivity.resize(3 * plane.material_groups.size());
+        plane.blocks[0].n_elements = plane.material_groups.size();
+    }
+
+    cout << "Local remeshing of 2D plane successful: Replaced " << removed.size() << " triangles by " << n_new << " around " << disks.size()
+         << " changed BHE positions, " << plane.n_nodes() << " nodes and " << plane.n_elements() << " elements..." << endl;
+    return true;
+}
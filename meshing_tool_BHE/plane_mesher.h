@@ -0,0 +1,34 @@
+#ifndef PLANE_MESHER_H
+#define PLANE_MESHER_H
+
+#include <vector>
+
+#include "compact_mesh.h"
+#include "meshing_tool_BHE.h"
+
+// Closed polygon of prescribed nodes, counter-clockwise, with the mesh size along it
+struct plane_hole
+{
+    std::vector<double> x, y;
+    double size;
+};
+
+// Built-in 2D mesher for the model plane, alternative to WriteGMSHgeo/StartGMSH/WaitGMSH/ImportGMSHmsh
+// Meshes the rectangular domain with the optional BOX, the BHE hexagons and the additional points
+// by Delaunay refinement. Mesh sizes follow the GMSH semantics of the .geo file: point sizes
+// (elem_size_corner, elem_size_box, alpha * radius, ADD_POINT delta) are interpolated linearly
+// along the boundary and box lines and over the triangulation of all size points.
+// An optional hole is left out of the mesh: its boundary nodes become nodes 0..n-1 of the plane,
+// the lines between them are kept unsplit and no BHE or additional point may lie inside.
+bool MeshPlane(const geometry &geom, const std::vector<bhe> &BHEs, const std::vector<additional_point> &add_points, compact_mesh &plane,
+               const plane_hole *hole = nullptr);
+
+// Incremental remeshing (-incremental): updates a plane meshed for old_BHEs to BHEs (matched by number)
+// by remeshing only the triangles within 4 * alpha * radius of the added, moved and removed BHEs.
+// The boundary of that region is kept and nodes and triangles outside keep their numbers, except for
+// the last ones that move into unused numbers when the region shrinks.
+// Returns false if the change can't be made locally (box lines nearby, region boundary not recoverable).
+bool RemeshPlaneLocally(const geometry &geom, const std::vector<bhe> &old_BHEs, const std::vector<bhe> &BHEs,
+                        const std::vector<additional_point> &add_points, compact_mesh &plane);
+
+#endif //PLANE_MESHER_H
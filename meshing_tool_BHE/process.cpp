@@ -0,0 +1,208 @@
+#include "pch.h"
+#include "process.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+#endif
+
+using namespace std;
+
+child_process::~child_process()
+{
+    if (running())
+        kill();
+}
+
+#ifdef _WIN32
+
+// Command line quoting as parsed by CommandLineToArgvW
+static string QuoteArgument(const string &arg)
+{
+    if (!arg.empty() && arg.find_first_of(" \t\"") == string::npos)
+        return arg;
+
+    string quoted = "\"";
+    size_t n_backslashes = 0;
+    for (char c : arg)
+    {
+        if (c == '\\')
+            n_backslashes++;
+        else
+        {
+            if (c == '"')
+                quoted.append(2 * n_backslashes + 1, '\\');
+            else
+                quoted.append(n_backslashes, '\\');
+            n_backslashes = 0;
+            quoted.push_back(c);
+        }
+    }
+    quoted.append(2 * n_backslashes, '\\');
+    return quoted.append("\"");
+}
+
+bool child_process::start(const vector<string> &args, const string &log_filename)
+{
+    if (args.empty() || running())
+        return false;
+
+    SECURITY_ATTRIBUTES inherit = { sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE };
+    HANDLE log_handle = CreateFileA(log_filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &inherit, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (log_handle == INVALID_HANDLE_VALUE)
+        return false;
+
+    string command_line;
+    for (size_t i = 0; i < args.size(); i++)
+        command_line.append(i > 0 ? " " : "").append(QuoteArgument(args[i]));
+
+    STARTUPINFOA startup_info;
+    ZeroMemory(&startup_info, sizeof(startup_info));
+    startup_info.cb = sizeof(startup_info);
+    startup_info.dwFlags = STARTF_USESTDHANDLES;
+    startup_info.hStdInput = nullptr;
+    startup_info.hStdOutput = log_handle;
+    startup_info.hStdError = log_handle;
+
+    PROCESS_INFORMATION process_info;
+    BOOL created = CreateProcessA(nullptr, &command_line[0], nullptr, nullptr, TRUE, CREATE_NO_WINDOW, nullptr, nullptr, &startup_info, &process_info);
+    CloseHandle(log_handle);
+    if (!created)
+        return false;
+
+    CloseHandle(process_info.hThread);
+    process_handle_ = process_info.hProcess;
+    start_time_ = chrono::steady_clock::now();
+    return true;
+}
+
+bool child_process::wait(double timeout_seconds, int &exit_code, bool &timed_out)
+{
+    timed_out = false;
+    if (!running())
+        return false;
+
+    double remaining = timeout_seconds - chrono::duration<double>(chrono::steady_clock::now() - start_time_).count();
+    DWORD timeout = (timeout_seconds > 0) ? static_cast<DWORD>(min(max(remaining, 0.0) * 1000.0, 4.0e9)) : INFINITE;
+    if (WaitForSingleObject(process_handle_, timeout) != WAIT_OBJECT_0)
+    {
+        kill();
+        timed_out = true;
+        return false;
+    }
+
+    DWORD code = 0;
+    GetExitCodeProcess(process_handle_, &code);
+    exit_code = static_cast<int>(code);
+    CloseHandle(process_handle_);
+    process_handle_ = nullptr;
+    return true;
+}
+
+bool child_process::running() const
+{
+    return process_handle_ != nullptr;
+}
+
+void child_process::kill()
+{
+    TerminateProcess(process_handle_, 1);
+    WaitForSingleObject(process_handle_, INFINITE);
+    CloseHandle(process_handle_);
+    process_handle_ = nullptr;
+}
+
+#else
+
+bool child_process::start(const vector<string> &args, const string &log_filename)
+{
+    if (args.empty() || running())
+        return false;
+
+    vector<char *> argv;
+    for (const string &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    // posix_spawn is safe in the threads of a batch, unlike fork
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, 1, log_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, 1, 2);
+
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0)
+        return false;
+
+    pid_ = pid;
+    start_time_ = chrono::steady_clock::now();
+    return true;
+}
+
+bool child_process::wait(double timeout_seconds, int &exit_code, bool &timed_out)
+{
+    timed_out = false;
+    if (!running())
+        return false;
+
+    chrono::milliseconds poll(1);
+
+    for (;;)
+    {
+        int status;
+        pid_t result = waitpid(pid_, &status, WNOHANG);
+        if (result == pid_)
+        {
+            exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            pid_ = -1;
+            return true;
+        }
+        if (result < 0)
+        {
+            pid_ = -1;
+            return false;
+        }
+
+        if (timeout_seconds > 0 && chrono::duration<double>(chrono::steady_clock::now() - start_time_).count() > timeout_seconds)
+        {
+            kill();
+            timed_out = true;
+            return false;
+        }
+
+        // Short polls for quick runs, at most 50 ms for long ones
+        this_thread::sleep_for(poll);
+        poll = min(poll * 2, chrono::milliseconds(50));
+    }
+}
+
+bool child_process::running() const
+{
+    return pid_ > 0;
+}
+
+void child_process::kill()
+{
+    int status;
+    ::kill(pid_, SIGKILL);
+    waitpid(pid_, &status, 0);
+    pid_ = -1;
+}
+
+#endif
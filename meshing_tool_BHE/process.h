@@ -0,0 +1,41 @@
+#ifndef PROCESS_H
+#define PROCESS_H
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Supervised child process, stdout and stderr go to a log file
+// A process still running on destruction is killed
+class child_process
+{
+public:
+    child_process() = default;
+    ~child_process();
+
+    child_process(const child_process &) = delete;
+    child_process &operator=(const child_process &) = delete;
+
+    // args[0] is the program, searched in PATH if it has no directory
+    bool start(const std::vector<std::string> &args, const std::string &log_filename);
+
+    // Waits until timeout_seconds after start (<= 0: no limit), kills the process on timeout
+    // Work done between start and wait counts against the timeout
+    // Returns false on timeout or if the process couldn't be waited for
+    bool wait(double timeout_seconds, int &exit_code, bool &timed_out);
+
+    bool running() const;
+
+private:
+    void kill();
+
+    std::chrono::steady_clock::time_point start_time_;
+
+#ifdef _WIN32
+    void *process_handle_ = nullptr;
+#else
+    int pid_ = -1;
+#endif
+};
+
+#endif //PROCESS_H
@@ -0,0 +1,204 @@
+#include "pch.h"
+#include "renumbering.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <vector>
+
+using namespace std;
+
+size_t PlaneBandwidth(const compact_mesh &plane)
+{
+    size_t bandwidth = 0;
+    for (size_t e = 0; e < plane.n_elements(); e++)
+    {
+        const uint32_t *nodes = plane.element_nodes(e);
+        int n_nodes = NodesPerElement(plane.block_of(e).type);
+        for (int i = 0; i < n_nodes; i++)
+            for (int j = i + 1; j < n_nodes; j++)
+                bandwidth = max<size_t>(bandwidth, nodes[i] > nodes[j] ? nodes[i] - nodes[j] : nodes[j] - nodes[i]);
+    }
+    return bandwidth;
+}
+
+// Node graph of the plane in compressed row storage, neighbours sorted by index
+// All nodes of an element are coupled, also the diagonals of quadrilaterals
+static void NodeGraph(const compact_mesh &plane, vector<size_t> &offsets, vector<uint32_t> &neighbours)
+{
+    size_t n_nodes = plane.n_nodes();
+    offsets.assign(n_nodes + 1, 0);
+
+    for (const element_block &block : plane.blocks)
+    {
+        int n = NodesPerElement(block.type);
+        const uint32_t *nodes = plane.connectivity.data() + block.first_connectivity;
+        for (size_t e = 0; e < block.n_elements; e++, nodes += n)
+            for (int k = 0; k < n; k++)
+                offsets[nodes[k] + 1] += n - 1;
+    }
+    partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+    neighbours.resize(offsets.back());
+    vector<size_t> fill_position(offsets.begin(), offsets.end() - 1);
+    for (const element_block &block : plane.blocks)
+    {
+        int n = NodesPerElement(block.type);
+        const uint32_t *nodes = plane.connectivity.data() + block.first_connectivity;
+        for (size_t e = 0; e < block.n_elements; e++, nodes += n)
+            for (int k = 0; k < n; k++)
+                for (int j = 1; j < n; j++)
+                    neighbours[fill_position[nodes[k]]++] = nodes[(k + j) % n];
+    }
+
+    // Remove the duplicates of edges shared by two elements
+    size_t n_unique = 0;
+    for (size_t n = 0; n < n_nodes; n++)
+    {
+        size_t first = offsets[n], last = offsets[n + 1];
+        sort(neighbours.begin() + first, neighbours.begin() + last);
+        size_t n_row = unique(neighbours.begin() + first, neighbours.begin() + last) - (neighbours.begin() + first);
+        copy(neighbours.begin() + first, neighbours.begin() + first + n_row, neighbours.begin() + n_unique);
+        offsets[n] = n_unique;
+        n_unique += n_row;
+    }
+    offsets[n_nodes] = n_unique;
+    neighbours.resize(n_unique);
+}
+
+// Breadth-first level structure from root, returns the depth and the
+// lowest degree node of the last level; visited nodes are listed in order
+static size_t LevelStructure(uint32_t root, const vector<size_t> &offsets, const vector<uint32_t> &neighbours, vector<int> &levels,
+                             vector<uint32_t> &order, uint32_t &last_node)
+{
+    order.clear();
+    order.push_back(root);
+    levels[root] = 0;
+    for (size_t i = 0; i < order.size(); i++)
+        for (size_t k = offsets[order[i]]; k < offsets[order[i] + 1]; k++)
+            if (levels[neighbours[k]] < 0)
+            {
+                levels[neighbours[k]] = levels[order[i]] + 1;
+                order.push_back(neighbours[k]);
+            }
+
+    int depth = levels[order.back()];
+    last_node = order.back();
+    for (uint32_t node : order)
+    {
+        if (levels[node] == depth && offsets[node + 1] - offsets[node] < offsets[last_node + 1] - offsets[last_node])
+            last_node = node;
+        levels[node] = -1;
+    }
+    return depth;
+}
+
+bool RenumberPlane(compact_mesh &plane)
+{
+    size_t n_nodes = plane.n_nodes();
+    size_t n_elems = plane.n_elements();
+
+    for (const element_block &block : plane.blocks)
+        if (block.type != element_type::tri && block.type != element_type::quad)
+        {
+            cout << "Error: Renumbering needs a plane of triangles and quadrilaterals!" << endl;
+            return false;
+        }
+
+    size_t bandwidth_before = PlaneBandwidth(plane);
+    vector<size_t> offsets;
+    vector<uint32_t> neighbours;
+    NodeGraph(plane, offsets, neighbours);
+    auto degree = [&](uint32_t node) { return offsets[node + 1] - offsets[node]; };
+
+    // Cuthill-McKee per connected component, started at a pseudo-peripheral node
+    vector<uint32_t> order, component;
+    vector<int> levels(n_nodes, -1);
+    vector<char> numbered(n_nodes, 0);
+    order.reserve(n_nodes);
+
+    for (uint32_t seed = 0; seed < n_nodes; seed++)
+    {
+        if (numbered[seed])
+            continue;
+
+        uint32_t root = seed, candidate;
+        size_t depth = LevelStructure(root, offsets, neighbours, levels, component, candidate);
+        for (;;)
+        {
+            uint32_t next_candidate;
+            size_t next_depth = LevelStructure(candidate, offsets, neighbours, levels, component, next_candidate);
+            if (next_depth <= depth)
+                break;
+            root = candidate;
+            depth = next_depth;
+            candidate = next_candidate;
+        }
+
+        size_t first = order.size();
+        order.push_back(root);
+        numbered[root] = 1;
+        for (size_t i = first; i < order.size(); i++)
+        {
+            size_t first_new = order.size();
+            for (size_t k = offsets[order[i]]; k < offsets[order[i] + 1]; k++)
+                if (!numbered[neighbours[k]])
+                {
+                    numbered[neighbours[k]] = 1;
+                    order.push_back(neighbours[k]);
+                }
+            // Unnumbered neighbours by increasing degree
+            stable_sort(order.begin() + first_new, order.end(), [&](uint32_t a, uint32_t b) { return degree(a) < degree(b); });
+        }
+    }
+
+    // Reverse and apply to the nodes
+    vector<uint32_t> new_index(n_nodes);
+    for (size_t k = 0; k < n_nodes; k++)
+        new_index[order[k]] = static_cast<uint32_t>(n_nodes - 1 - k);
+
+    vector<double> x(n_nodes), y(n_nodes), z(n_nodes);
+    for (size_t n = 0; n < n_nodes; n++)
+    {
+        x[new_index[n]] = plane.x[n];
+        y[new_index[n]] = plane.y[n];
+        z[new_index[n]] = plane.z[n];
+    }
+    plane.x.swap(x);
+    plane.y.swap(y);
+    plane.z.swap(z);
+    for (uint32_t &node : plane.connectivity)
+        node = new_index[node];
+
+    // Elements follow the nodes within their block, orientation is kept
+    vector<uint32_t> element_order(n_elems);
+    vector<uint32_t> lowest(n_elems);
+    for (size_t e = 0; e < n_elems; e++)
+    {
+        const uint32_t *nodes = plane.element_nodes(e);
+        lowest[e] = *min_element(nodes, nodes + NodesPerElement(plane.block_of(e).type));
+        element_order[e] = static_cast<uint32_t>(e);
+    }
+
+    vector<uint32_t> connectivity(plane.connectivity.size());
+    vector<uint16_t> material_groups(n_elems);
+    for (const element_block &block : plane.blocks)
+    {
+        int n = NodesPerElement(block.type);
+        auto first = element_order.begin() + block.first_element, last = first + block.n_elements;
+        stable_sort(first, last, [&](uint32_t a, uint32_t b) { return lowest[a] < lowest[b]; });
+        for (size_t k = 0; k < block.n_elements; k++)
+        {
+            uint32_t e = first[k];
+            const uint32_t *nodes = plane.connectivity.data() + block.first_connectivity + (e - block.first_element) * n;
+            copy(nodes, nodes + n, connectivity.begin() + block.first_connectivity + k * n);
+            material_groups[block.first_element + k] = plane.material_groups[e];
+        }
+    }
+    plane.connectivity.swap(connectivity);
+    plane.material_groups.swap(material_groups);
+
+    cout << "Renumbering of 2D mesh successful: Bandwidth " << bandwidth_before << " -> " << PlaneBandwidth(plane) << "..." << endl;
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef RENUMBERING_H
+#define RENUMBERING_H
+
+#include <cstddef>
+
+#include "compact_mesh.h"
+
+// Largest node index difference within the elements of the plane
+size_t PlaneBandwidth(const compact_mesh &plane);
+
+// Reverse Cuthill-McKee renumbering of the 2D plane, applied before extrusion
+// Node coordinates and connectivity are permuted, elements are sorted by their lowest new node within their block
+bool RenumberPlane(compact_mesh &plane);
+
+#endif //RENUMBERING_H
@@ -0,0 +1,117 @@
+#include "pch.h"
+#include "spatial_hash.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace std;
+
+spatial_hash::spatial_hash(double cell_size) : cell_size_(cell_size > 0 ? cell_size : 1.0)
+{
+}
+
+void spatial_hash::reserve(size_t n)
+{
+    x_.reserve(n);
+    y_.reserve(n);
+}
+
+void spatial_hash::add(double x, double y)
+{
+    x_.push_back(x);
+    y_.push_back(y);
+}
+
+int64_t spatial_hash::Cell(double value) const
+{
+    // Clamp to 32 bit cells, points in clamped cells are still compared by distance
+    double cell = floor(value / cell_size_);
+    cell = max(-2147483648.0, min(2147483647.0, cell));
+    return static_cast<int64_t>(cell);
+}
+
+uint64_t spatial_hash::Key(int64_t ix, int64_t iy)
+{
+    return (static_cast<uint64_t>(static_cast<uint32_t>(ix)) << 32) | static_cast<uint32_t>(iy);
+}
+
+void spatial_hash::build()
+{
+    size_t n = x_.size();
+    vector<uint64_t> point_keys(n);
+
+    for (size_t i = 0; i < n; i++)
+        point_keys[i] = Key(Cell(x_[i]), Cell(y_[i]));
+
+    index_.resize(n);
+    iota(index_.begin(), index_.end(), 0);
+    stable_sort(index_.begin(), index_.end(), [&](int a, int b) { return point_keys[a] < point_keys[b]; });
+
+    keys_.resize(n);
+    for (size_t i = 0; i < n; i++)
+        keys_[i] = point_keys[index_[i]];
+}
+
+void spatial_hash::CellRange(uint64_t key, size_t &first, size_t &last) const
+{
+    auto range = equal_range(keys_.begin(), keys_.end(), key);
+    first = range.first - keys_.begin();
+    last = range.second - keys_.begin();
+}
+
+int spatial_hash::nearest(double x, double y, double radius) const
+{
+    int64_t ix0 = Cell(x - radius), ix1 = Cell(x + radius);
+    int64_t iy0 = Cell(y - radius), iy1 = Cell(y + radius);
+    double radius2 = radius * radius;
+    double best_dist2 = radius2;
+    int best = -1;
+
+    for (int64_t ix = ix0; ix <= ix1; ix++)
+        for (int64_t iy = iy0; iy <= iy1; iy++)
+        {
+            size_t first, last;
+            CellRange(Key(ix, iy), first, last);
+
+            for (size_t k = first; k < last; k++)
+            {
+                int idx = index_[k];
+                double dx = x_[idx] - x;
+                double dy = y_[idx] - y;
+                double dist2 = dx * dx + dy * dy;
+
+                // Ties go to the lower index to keep results deterministic
+                if (dist2 <= radius2 && (best < 0 || dist2 < best_dist2 || (dist2 == best_dist2 && idx < best)))
+                {
+                    best_dist2 = dist2;
+                    best = idx;
+                }
+            }
+        }
+
+    return best;
+}
+
+void spatial_hash::within(double x, double y, double radius, vector<int> &result) const
+{
+    int64_t ix0 = Cell(x - radius), ix1 = Cell(x + radius);
+    int64_t iy0 = Cell(y - radius), iy1 = Cell(y + radius);
+    double radius2 = radius * radius;
+
+    for (int64_t ix = ix0; ix <= ix1; ix++)
+        for (int64_t iy = iy0; iy <= iy1; iy++)
+        {
+            size_t first, last;
+            CellRange(Key(ix, iy), first, last);
+
+            for (size_t k = first; k < last; k++)
+            {
+                int idx = index_[k];
+                double dx = x_[idx] - x;
+                double dy = y_[idx] - y;
+                if (dx * dx + dy * dy <= radius2)
+                    result.push_back(idx);
+            }
+        }
+}
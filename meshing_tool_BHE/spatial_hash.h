@@ -0,0 +1,38 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over 2D points for radius queries
+// Points are added first, build() sorts them by cell, queries are read-only afterwards
+class spatial_hash
+{
+public:
+    explicit spatial_hash(double cell_size = 1.0);
+
+    void reserve(size_t n);
+    void add(double x, double y);
+    void build();
+
+    size_t size() const { return x_.size(); }
+
+    // Index of the closest point within radius, -1 if there is none
+    int nearest(double x, double y, double radius) const;
+
+    // Indices of all points within radius (appended to result)
+    void within(double x, double y, double radius, std::vector<int> &result) const;
+
+private:
+    int64_t Cell(double value) const;
+    static uint64_t Key(int64_t ix, int64_t iy);
+    void CellRange(uint64_t key, size_t &first, size_t &last) const;
+
+    double cell_size_;
+    std::vector<double> x_, y_;
+    std::vector<uint64_t> keys_;    // sorted cell keys
+    std::vector<int> index_;        // point index per sorted key
+};
+
+#endif //SPATIAL_HASH_H
@@ -0,0 +1,43 @@
+#include "pch.h"
+#include "text_output.h"
+
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Items per chunk, large enough to amortize thread hand-off, small enough to bound buffer memory
+static const size_t chunk_size = 1 << 16;
+
+void WriteChunked(ostream &out, size_t n_items, int n_threads, const function<void(size_t first, size_t last, text_buffer &buffer)> &format)
+{
+    size_t n_chunks = (n_items + chunk_size - 1) / chunk_size;
+    size_t n_workers = max<size_t>(1, min<size_t>(n_threads, n_chunks));
+    vector<text_buffer> buffers(n_workers);
+
+    // Batches of n_workers chunks, formatted concurrently and written in order
+    for (size_t batch_start = 0; batch_start < n_chunks; batch_start += n_workers)
+    {
+        size_t batch_end = min(n_chunks, batch_start + n_workers);
+        auto format_chunk = [&](size_t chunk) {
+            text_buffer &buffer = buffers[chunk - batch_start];
+            buffer.clear();
+            format(chunk * chunk_size, min(n_items, (chunk + 1) * chunk_size), buffer);
+        };
+
+        if (batch_end - batch_start == 1)
+            format_chunk(batch_start);
+        else
+        {
+            vector<thread> workers;
+            for (size_t chunk = batch_start; chunk < batch_end; chunk++)
+                workers.emplace_back(format_chunk, chunk);
+            for (thread &worker : workers)
+                worker.join();
+        }
+
+        for (size_t chunk = batch_start; chunk < batch_end; chunk++)
+            out.write(buffers[chunk - batch_start].data(), buffers[chunk - batch_start].size());
+    }
+}
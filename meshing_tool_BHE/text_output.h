@@ -0,0 +1,42 @@
+#ifndef TEXT_OUTPUT_H
+#define TEXT_OUTPUT_H
+
+#include <charconv>
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+// Append-only character buffer with to_chars based number formatting
+// Doubles are written in shortest round-trip representation
+class text_buffer
+{
+public:
+    void clear() { data_.clear(); }
+    void reserve(size_t n) { data_.reserve(n); }
+    const char *data() const { return data_.data(); }
+    size_t size() const { return data_.size(); }
+
+    text_buffer &put(char c) { data_.push_back(c); return *this; }
+    text_buffer &put(const char *s) { data_.append(s); return *this; }
+    text_buffer &put(const std::string &s) { data_.append(s); return *this; }
+
+    template <typename T>
+    typename std::enable_if<std::is_arithmetic<T>::value, text_buffer &>::type put(T value)
+    {
+        char digits[32];
+        std::to_chars_result result = std::to_chars(digits, digits + sizeof(digits), value);
+        data_.append(digits, result.ptr);
+        return *this;
+    }
+
+private:
+    std::string data_;
+};
+
+// Formats the items [0, n_items) chunk by chunk on up to n_threads threads
+// and writes the chunks to out in their original order
+void WriteChunked(std::ostream &out, size_t n_items, int n_threads, const std::function<void(size_t first, size_t last, text_buffer &buffer)> &format);
+
+#endif //TEXT_OUTPUT_H
@@ -0,0 +1,178 @@
+#include "pch.h"
+#include "vtu_writer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+
+#include "compact_mesh.h"
+#include "extruded_mesh.h"
+#include "mesh_cache.h"
+
+using namespace std;
+
+static uint8_t VTKcellType(element_type type)
+{
+    switch (type)
+    {
+    case element_type::line:
+        return 3;
+    case element_type::tri:
+        return 5;
+    case element_type::pris:
+        return 13;
+    case element_type::quad:
+        return 9;
+    case element_type::hex:
+        return 12;
+    }
+    return 0;
+}
+
+// Entities per buffered write
+static const size_t chunk_size = 1 << 16;
+
+static bool IsLittleEndian()
+{
+    const uint16_t probe = 1;
+    return *reinterpret_cast<const uint8_t *>(&probe) == 1;
+}
+
+// Writes one appended array: UInt64 byte count followed by the raw data,
+// fill(first, last, buffer) appends the values of entities [first, last)
+template <typename T, typename Fill>
+static void WriteAppendedArray(ostream &out, size_t n_entities, size_t values_per_entity, Fill fill)
+{
+    uint64_t n_bytes = static_cast<uint64_t>(n_entities) * values_per_entity * sizeof(T);
+    out.write(reinterpret_cast<const char *>(&n_bytes), sizeof(n_bytes));
+
+    vector<T> buffer;
+    buffer.reserve(min(n_entities, chunk_size) * values_per_entity);
+
+    for (size_t first = 0; first < n_entities; first += chunk_size)
+    {
+        size_t last = min(n_entities, first + chunk_size);
+        buffer.clear();
+        fill(first, last, buffer);
+        out.write(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(T));
+    }
+}
+
+template <typename Mesh>
+bool WriteVTU(const string project_name, const Mesh &mesh, uint64_t *bytes_written)
+{
+    // Declarations
+    string vtu_filename = project_name;
+    vtu_filename.append(".vtu");
+    replacing_ofstream vtu_file(vtu_filename);
+    bool changed;
+
+    size_t n_nodes = mesh.n_nodes();
+    size_t n_cells = mesh.n_elements();
+    size_t n_connectivity = mesh.n_connectivity();
+
+    if (!vtu_file.is_open())
+    {
+        cout << "Error: Couldn't open VTU file!" << endl;
+        return false;
+    }
+
+    // Offsets into the appended data block, each array is prefixed by its UInt64 size
+    uint64_t offset_points = 0;
+    uint64_t offset_connectivity = offset_points + sizeof(uint64_t) + n_nodes * 3 * sizeof(double);
+    uint64_t offset_offsets = offset_connectivity + sizeof(uint64_t) + n_connectivity * sizeof(int32_t);
+    uint64_t offset_types = offset_offsets + sizeof(uint64_t) + n_cells * sizeof(int64_t);
+    uint64_t offset_materials = offset_types + sizeof(uint64_t) + n_cells * sizeof(uint8_t);
+
+    // Write header
+    vtu_file << "<?xml version=\"1.0\"?>\n";
+    vtu_file << "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" byte_order=\"" << (IsLittleEndian() ? "LittleEndian" : "BigEndian") << "\" header_type=\"UInt64\">\n";
+    vtu_file << "  <UnstructuredGrid>\n";
+    vtu_file << "    <Piece NumberOfPoints=\"" << n_nodes << "\" NumberOfCells=\"" << n_cells << "\">\n";
+    vtu_file << "      <Points>\n";
+    vtu_file << "        <DataArray type=\"Float64\" NumberOfComponents=\"3\" format=\"appended\" offset=\"" << offset_points << "\"/>\n";
+    vtu_file << "      </Points>\n";
+    vtu_file << "      <Cells>\n";
+    vtu_file << "        <DataArray type=\"Int32\" Name=\"connectivity\" format=\"appended\" offset=\"" << offset_connectivity << "\"/>\n";
+    vtu_file << "        <DataArray type=\"Int64\" Name=\"offsets\" format=\"appended\" offset=\"" << offset_offsets << "\"/>\n";
+    vtu_file << "        <DataArray type=\"UInt8\" Name=\"types\" format=\"appended\" offset=\"" << offset_types << "\"/>\n";
+    vtu_file << "      </Cells>\n";
+    vtu_file << "      <CellData>\n";
+    vtu_file << "        <DataArray type=\"Int32\" Name=\"MaterialIDs\" format=\"appended\" offset=\"" << offset_materials << "\"/>\n";
+    vtu_file << "      </CellData>\n";
+    vtu_file << "    </Piece>\n";
+    vtu_file << "  </UnstructuredGrid>\n";
+    vtu_file << "  <AppendedData encoding=\"raw\">\n";
+    vtu_file << "_";
+
+    // Write points
+    WriteAppendedArray<double>(vtu_file, n_nodes, 3, [&](size_t first, size_t last, vector<double> &buffer) {
+        for (size_t i = first; i < last; i++)
+        {
+            mesh_node this_node = mesh.node_at(i);
+            buffer.push_back(this_node.x);
+            buffer.push_back(this_node.y);
+            buffer.push_back(this_node.z);
+        }
+    });
+
+    // Write connectivity, nodes are stored as unsigned but fit into Int32
+    uint64_t n_bytes = static_cast<uint64_t>(n_connectivity) * sizeof(int32_t);
+    vtu_file.write(reinterpret_cast<const char *>(&n_bytes), sizeof(n_bytes));
+    vector<uint32_t> connectivity;
+    for (size_t first = 0; first < n_cells; first += chunk_size)
+    {
+        size_t last = min(n_cells, first + chunk_size);
+        connectivity.clear();
+        for (size_t i = first; i < last; i++)
+        {
+            mesh_element this_element = mesh.element_at(i);
+            connectivity.insert(connectivity.end(), this_element.nodes, this_element.nodes + this_element.n_nodes);
+        }
+        vtu_file.write(reinterpret_cast<const char *>(connectivity.data()), connectivity.size() * sizeof(uint32_t));
+    }
+
+    // Write offsets
+    int64_t offset = 0;
+    WriteAppendedArray<int64_t>(vtu_file, n_cells, 1, [&](size_t first, size_t last, vector<int64_t> &buffer) {
+        for (size_t i = first; i < last; i++)
+        {
+            offset += mesh.element_at(i).n_nodes;
+            buffer.push_back(offset);
+        }
+    });
+
+    // Write cell types
+    WriteAppendedArray<uint8_t>(vtu_file, n_cells, 1, [&](size_t first, size_t last, vector<uint8_t> &buffer) {
+        for (size_t i = first; i < last; i++)
+            buffer.push_back(VTKcellType(mesh.element_at(i).type));
+    });
+
+    // Write material groups
+    WriteAppendedArray<int32_t>(vtu_file, n_cells, 1, [&](size_t first, size_t last, vector<int32_t> &buffer) {
+        for (size_t i = first; i < last; i++)
+            buffer.push_back(mesh.element_at(i).material_group);
+    });
+
+    vtu_file << "\n  </AppendedData>\n";
+    vtu_file << "</VTKFile>\n";
+
+    // Unchanged files are not rewritten
+    if (!vtu_file.commit(changed))
+    {
+        cout << "Error: Couldn't write VTU file " << vtu_filename << "!" << endl;
+        return false;
+    }
+    if (bytes_written)
+        *bytes_written += vtu_file.bytes_written();
+
+    if (changed)
+        cout << "Write mesh to " << vtu_filename << " successful..." << endl;
+    else
+        cout << "Mesh file " << vtu_filename << " is unchanged..." << endl;
+    return true;
+}
+
+template bool WriteVTU<extruded_mesh>(const string project_name, const extruded_mesh &mesh, uint64_t *bytes_written);
+template bool WriteVTU<compact_mesh>(const string project_name, const compact_mesh &mesh, uint64_t *bytes_written);
@@ -0,0 +1,13 @@
+#ifndef VTU_WRITER_H
+#define VTU_WRITER_H
+
+#include <cstdint>
+#include <string>
+
+// Writes a mesh (extruded_mesh or compact_mesh) as VTK XML unstructured grid (.vtu)
+// with all arrays appended as raw binary, prisms are VTK_WEDGE and BHEs VTK_LINE
+// bytes_written gets the bytes that went to disk, 0 for an unchanged file
+template <typename Mesh>
+bool WriteVTU(const std::string project_name, const Mesh &mesh, uint64_t *bytes_written = nullptr);
+
+#endif //VTU_WRITER_H
@@ -0,0 +1,67 @@
+#include "pch.h"
+/*
+GMSH IMPORT CHECK
+------------------------------------------------------------------------------
+* Imports two GMSH msh2 files, e.g. the ASCII and the binary form of one mesh
+* Passes if both give the same plane: nodes, element blocks and connectivity
+------------------------------------------------------------------------------
+Usage: msh_import_check first.msh second.msh
+*/
+
+#include <iostream>
+#include <string>
+
+#include "compact_mesh.h"
+#include "pipeline.h"
+
+using namespace std;
+
+static bool SameBlocks(const compact_mesh &a, const compact_mesh &b)
+{
+    if (a.blocks.size() != b.blocks.size())
+        return false;
+    for (size_t k = 0; k < a.blocks.size(); k++)
+        if (a.blocks[k].type != b.blocks[k].type || a.blocks[k].n_elements != b.blocks[k].n_elements)
+            return false;
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        cout << "Usage: msh_import_check first.msh second.msh" << endl;
+        return 2;
+    }
+
+    // ImportGMSHmsh takes the project name and appends .msh
+    compact_mesh planes[2];
+    for (int k = 0; k < 2; k++)
+    {
+        string project_name = argv[k + 1];
+        if (project_name.size() > 4 && project_name.compare(project_name.size() - 4, 4, ".msh") == 0)
+            project_name.erase(project_name.size() - 4);
+        if (!ImportGMSHmsh(project_name, planes[k]))
+            return 1;
+    }
+
+    const compact_mesh &a = planes[0], &b = planes[1];
+    if (a.n_nodes() == 0 || a.n_elements() == 0)
+    {
+        cout << "Error: Empty plane imported from " << argv[1] << "!" << endl;
+        return 1;
+    }
+    if (a.x != b.x || a.y != b.y || a.z != b.z)
+    {
+        cout << "Error: Nodes differ: " << a.n_nodes() << " and " << b.n_nodes() << " nodes!" << endl;
+        return 1;
+    }
+    if (!SameBlocks(a, b) || a.connectivity != b.connectivity || a.material_groups != b.material_groups)
+    {
+        cout << "Error: Elements differ: " << a.n_elements() << " and " << b.n_elements() << " elements!" << endl;
+        return 1;
+    }
+
+    cout << "Same plane: " << a.n_nodes() << " nodes and " << a.n_elements() << " elements..." << endl;
+    return 0;
+}
@@ -0,0 +1,65 @@
+# Regression case: runs bhe_setup_tool on a test input in a fresh directory and checks the result
+#   TOOL        bhe_setup_tool executable
+#   DATA_DIR    directory of the test inputs
+#   WORK_DIR    directory of the runs, emptied first
+#   INPUT       input file, copied to WORK_DIR together with the space separated FILES
+#   ARGS        space separated options after the input file
+#   RUNS        number of runs, default 1; later runs have to reproduce OUTPUT of the first run
+#   OUTPUT      file written by the runs, compared with REFERENCE if given
+#   EXPECT      regular expression the output of the last run has to match
+#   SHOULD_FAIL run has to fail: no "Program terminated normally" and no OUTPUT written
+
+if(NOT RUNS)
+    set(RUNS 1)
+endif()
+separate_arguments(ARGS UNIX_COMMAND "${ARGS}")
+separate_arguments(FILES UNIX_COMMAND "${FILES}")
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+foreach(name IN LISTS INPUT FILES)
+    configure_file("${DATA_DIR}/${name}" "${WORK_DIR}/${name}" COPYONLY)
+endforeach()
+
+foreach(run RANGE 1 ${RUNS})
+    # Later runs write OUTPUT from scratch, from what the first run left behind (e.g. the cache)
+    if(run GREATER 1)
+        file(RENAME "${WORK_DIR}/${OUTPUT}" "${WORK_DIR}/${OUTPUT}.first")
+        file(REMOVE "${WORK_DIR}/${OUTPUT}.hash")
+    endif()
+
+    execute_process(COMMAND "${TOOL}" "${INPUT}" ${ARGS}
+                    WORKING_DIRECTORY "${WORK_DIR}"
+                    RESULT_VARIABLE result
+                    OUTPUT_VARIABLE output
+                    ERROR_VARIABLE output)
+    message("${output}")
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "Run ${run} exited with ${result}")
+    endif()
+
+    if(SHOULD_FAIL)
+        if(output MATCHES "Program terminated normally" OR EXISTS "${WORK_DIR}/${OUTPUT}")
+            message(FATAL_ERROR "Run ${run} should have failed")
+        endif()
+    elseif(NOT output MATCHES "Program terminated normally")
+        message(FATAL_ERROR "Run ${run} failed")
+    endif()
+
+    if(REFERENCE)
+        execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/${OUTPUT}" "${DATA_DIR}/${REFERENCE}" RESULT_VARIABLE different)
+        if(different)
+            message(FATAL_ERROR "Run ${run}: ${OUTPUT} differs from ${REFERENCE}")
+        endif()
+    endif()
+    if(run GREATER 1)
+        execute_process(COMMAND "${CMAKE_COMMAND}" -E compare_files "${WORK_DIR}/${OUTPUT}" "${WORK_DIR}/${OUTPUT}.first" RESULT_VARIABLE different)
+        if(different)
+            message(FATAL_ERROR "Run ${run}: ${OUTPUT} differs from the first run")
+        endif()
+    endif()
+endforeach()
+
+if(EXPECT AND NOT output MATCHES "${EXPECT}")
+    message(FATAL_ERROR "Output doesn't match ${EXPECT}")
+endif()